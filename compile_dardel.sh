@@ -1,2 +1,8 @@
 #/bin/bash
-CC -std=c++20 -O3 src/main_mpi.cpp
\ No newline at end of file
+CC -std=c++20 -O3 src/main_mpi.cpp
+CC -std=c++20 -O3 src/generate_scene.cpp -o generate_scene
+CC -std=c++20 -O3 -DNO_SIMD tests/vec_simd_test.cpp -o vec_simd_test_generic
+CC -std=c++20 -O3 tests/vec_simd_test.cpp -o vec_simd_test
+./vec_simd_test_generic > vec_simd_generic.txt && ./vec_simd_test vec_simd_generic.txt
+CC -std=c++20 -O3 tests/splat_random_test.cpp -o splat_random_test
+./splat_random_test
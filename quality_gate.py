@@ -0,0 +1,204 @@
+"""Image-quality gate for the fast paths of the renderer.
+
+Renders a fixed set of cameras with every option listed in the config file
+on --np ranks, and with the reference of the option: the same rank count
+and base arguments, with only the option switched off. A decomposition is
+compared with the exact sort-last render on one rank instead (its
+reference_np). Each image is compared with its reference (PSNR, SSIM, max
+abs error) and the timings of both are recorded. Exits with status 1 if any
+option falls below one of its thresholds.
+
+$ python3 quality_gate.py --config quality_gate.json --np 4
+"""
+from argparse import ArgumentParser
+from array import array
+from dataclasses import dataclass, asdict
+from pathlib import Path
+import json
+import math
+import struct
+import subprocess
+import sys
+import tempfile
+
+
+@dataclass
+class Image:
+    w: int
+    h: int
+    rgb: bytes  # Top row first, three bytes per pixel
+
+
+def read_bmp(path):
+    """Reads a 24-bit BMP as written by Image::store_image."""
+    d = Path(path).read_bytes()
+    offset = struct.unpack_from('<I', d, 10)[0]
+    w, h = struct.unpack_from('<ii', d, 18)
+    stride = (w * 3 + 3) & ~3
+    rows = []
+    for y in range(abs(h)):
+        src = abs(h) - 1 - y if h > 0 else y
+        row = d[offset + src * stride:offset + src * stride + w * 3]
+        # BGR to RGB
+        rgb = bytearray(len(row))
+        rgb[0::3], rgb[1::3], rgb[2::3] = row[2::3], row[1::3], row[0::3]
+        rows.append(bytes(rgb))
+    return Image(w, abs(h), b''.join(rows))
+
+
+def psnr(a, b):
+    se = sum((x - y) * (x - y) for x, y in zip(a.rgb, b.rgb))
+    if se == 0:
+        return math.inf
+    return 10 * math.log10(255 * 255 * len(a.rgb) / se)
+
+
+def max_abs(a, b):
+    return max(abs(x - y) for x, y in zip(a.rgb, b.rgb))
+
+
+def luma(img):
+    p = img.rgb
+    return array('d', (0.299 * p[i] + 0.587 * p[i + 1] + 0.114 * p[i + 2]
+                       for i in range(0, len(p), 3)))
+
+
+def integral(values, w, h):
+    """Summed-area table with a zero first row and column."""
+    s = array('d', bytes(8 * (w + 1) * (h + 1)))
+    for y in range(h):
+        run = 0.0
+        row, above = (y + 1) * (w + 1), y * (w + 1)
+        for x in range(w):
+            run += values[y * w + x]
+            s[row + x + 1] = s[above + x + 1] + run
+    return s
+
+
+def ssim(a, b, window=8, step=4):
+    """Mean SSIM of the luma over window x window boxes every step pixels."""
+    w, h = a.w, a.h
+    x, y = luma(a), luma(b)
+    tables = [integral(v, w, h) for v in
+              (x, y, array('d', (v * v for v in x)),
+               array('d', (v * v for v in y)),
+               array('d', (u * v for u, v in zip(x, y))))]
+    c1, c2 = (0.01 * 255) ** 2, (0.03 * 255) ** 2
+    n = window * window
+    total, count = 0.0, 0
+    for y0 in range(0, h - window + 1, step):
+        top, bottom = y0 * (w + 1), (y0 + window) * (w + 1)
+        for x0 in range(0, w - window + 1, step):
+            sx, sy, sxx, syy, sxy = (
+                t[bottom + x0 + window] - t[bottom + x0] -
+                t[top + x0 + window] + t[top + x0] for t in tables)
+            mx, my = sx / n, sy / n
+            vx, vy = sxx / n - mx * mx, syy / n - my * my
+            cov = sxy / n - mx * my
+            total += ((2 * mx * my + c1) * (2 * cov + c2) /
+                      ((mx * mx + my * my + c1) * (vx + vy + c2)))
+            count += 1
+    return total / count
+
+
+def render(opt, np, args, camera, image, timings):
+    """Renders one camera on np ranks and returns the phase times of the
+    benchmark record."""
+    cmd = [*opt.mpirun.split(), '-n', str(np), opt.binary, *args,
+           '--cameras', str(opt.cameras), '--camera', str(camera),
+           '--output', str(image), '--benchmark', str(timings),
+           '--warmup', str(opt.warmup), '--repeat', str(opt.repeat)]
+    if opt.file:
+        cmd += ['--file', opt.file]
+    timings.unlink(missing_ok=True)
+    r = subprocess.run(cmd, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE,
+                       text=True)
+    if r.returncode != 0:
+        sys.exit(f"{' '.join(cmd)} failed:\n{r.stderr}")
+    record = json.loads(timings.read_text().splitlines()[-1])
+    return {p: record['phases'][p]['median'] for p in ('render', 'frame')}
+
+
+@dataclass
+class Result:
+    option: str
+    reference: str  # Rank count and arguments of the reference
+    camera: int
+    psnr: float
+    ssim: float
+    max_abs: int
+    render_ms: float
+    frame_ms: float
+    reference_render_ms: float
+    reference_frame_ms: float
+    passed: bool
+
+
+def main():
+    parser = ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('--config', default='quality_gate.json')
+    parser.add_argument('--binary', default='./a.out')
+    parser.add_argument('--mpirun', default='mpirun')
+    parser.add_argument('--np', type=int, default=4,
+                        help='ranks of the options and, unless an option '
+                        'gives its reference_np, of their references')
+    parser.add_argument('--file', help='PLY file, the default of a.out if '
+                        'not given')
+    parser.add_argument('--results', default='quality_gate_results.json')
+    opt = parser.parse_args()
+    config = json.loads(Path(opt.config).read_text())
+    opt.cameras = config.get('cameras', 4)
+    opt.warmup = config.get('warmup', 1)
+    opt.repeat = config.get('repeat', 3)
+    defaults = config.get('defaults', [])
+
+    results = []
+    with tempfile.TemporaryDirectory() as tmp:
+        tmp = Path(tmp)
+        timings = tmp / 'timings.json'
+        for camera in range(opt.cameras):
+            # Options with the same reference share one render of it.
+            references = {}
+            for option in config['options']:
+                np = option.get('np', opt.np)
+                ref_np = option.get('reference_np', np)
+                ref_args = defaults + option.get('base', [])
+                key = (ref_np, tuple(ref_args))
+                if key not in references:
+                    ref_image = tmp / f'reference_{len(references)}.bmp'
+                    ref_times = render(opt, ref_np, ref_args, camera,
+                                       ref_image, timings)
+                    references[key] = (read_bmp(ref_image), ref_times)
+                ref, ref_times = references[key]
+                image = tmp / f"{option['name']}_{camera}.bmp"
+                times = render(opt, np, ref_args + option['args'], camera,
+                               image, timings)
+                img = read_bmp(image)
+                q_psnr, q_ssim, q_max = psnr(ref, img), ssim(ref, img), \
+                    max_abs(ref, img)
+                passed = (q_psnr >= option.get('min_psnr', 0) and
+                          q_ssim >= option.get('min_ssim', 0) and
+                          q_max <= option.get('max_abs', 255))
+                results.append(Result(
+                    option['name'],
+                    ' '.join([f'np {ref_np}'] + option.get('base', [])),
+                    camera,
+                    q_psnr if q_psnr != math.inf else 999.0, q_ssim, q_max,
+                    times['render'], times['frame'], ref_times['render'],
+                    ref_times['frame'], passed))
+                r = results[-1]
+                print(f"{r.option:>16} camera {camera}: PSNR {r.psnr:6.2f} "
+                      f"SSIM {r.ssim:.4f} max {r.max_abs:3d}  render "
+                      f"{r.render_ms:8.1f} ms (ref {r.reference_render_ms:8.1f})"
+                      f"  {'ok' if passed else 'FAIL'}")
+
+    Path(opt.results).write_text(json.dumps([asdict(r) for r in results],
+                                            indent=1))
+    failed = sorted({r.option for r in results if not r.passed})
+    if failed:
+        print('Below threshold: ' + ', '.join(failed))
+        sys.exit(1)
+
+
+if __name__ == '__main__':
+    main()
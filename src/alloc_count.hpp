@@ -0,0 +1,55 @@
+#ifndef ALLOC_COUNT_IMPORT
+#define ALLOC_COUNT_IMPORT 1
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+/*
+ * Heap allocation counting, compiled in with -DCOUNT_ALLOCATIONS, which
+ * replaces the global operator new with one that counts its calls. Meant
+ * for checking that repeated frames allocate nothing; allocations MPI makes
+ * with malloc are not counted. Include it from one translation unit only.
+ */
+
+/// Calls of operator new so far, on all threads
+inline std::atomic<long> allocation_count{0};
+
+/**
+ * @brief Heap allocations so far, or -1 if counting is not compiled in.
+ */
+inline long heap_allocations() {
+#ifdef COUNT_ALLOCATIONS
+    return allocation_count.load(std::memory_order_relaxed);
+#else
+    return -1;
+#endif
+}
+
+#ifdef COUNT_ALLOCATIONS
+void *operator new(std::size_t size) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    size_t a = static_cast<size_t>(alignment);
+    if (void *p = std::aligned_alloc(a, (size + a - 1) / a * a)) return p;
+    throw std::bad_alloc();
+}
+
+// GCC takes the free below for a mismatch with the replaced operator new.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+void operator delete(void *p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept {
+    std::free(p);
+}
+#pragma GCC diagnostic pop
+#endif
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef ARENA_IMPORT
+#define ARENA_IMPORT 1
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <span>
+
+/**
+ * @brief A single aligned allocation that hands out aligned columns by
+ * bumping an offset.
+ *
+ * Columns live until the next reserve() or the destruction of the arena.
+ * Only types that need no construction (floats, vec, mat) may be allocated.
+ */
+struct Arena {
+    static constexpr size_t alignment = 64;
+
+    struct Free {
+        void operator()(std::byte *p) const {
+            ::operator delete[](p, std::align_val_t(alignment));
+        }
+    };
+
+    std::unique_ptr<std::byte[], Free> buf;
+    size_t capacity = 0, used = 0;
+
+    /**
+     * @brief Rounds a size in bytes up to the alignment.
+     */
+    static size_t padded(size_t bytes) {
+        return (bytes + alignment - 1) / alignment * alignment;
+    }
+
+    /**
+     * @brief Makes room for at least the given number of bytes and forgets
+     * all earlier columns. Only reallocates when the arena has to grow, and
+     * then by at least half, so that sizes creeping up from frame to frame
+     * settle after a few reallocations.
+     *
+     * @param bytes The total padded size of the columns to allocate.
+     */
+    void reserve(size_t bytes) {
+        if (bytes > capacity) {
+            if (capacity > 0) bytes = std::max(bytes, padded(capacity * 3 / 2));
+            buf.reset(static_cast<std::byte *>(
+                ::operator new[](bytes, std::align_val_t(alignment))));
+            capacity = bytes;
+        }
+        used = 0;
+    }
+
+    /**
+     * @brief Carves an aligned column of n elements out of the arena.
+     */
+    template <typename T>
+    std::span<T> alloc(size_t n) {
+        assert(used + padded(n * sizeof(T)) <= capacity);
+        auto column = std::span<T>(reinterpret_cast<T *>(buf.get() + used), n);
+        used += padded(n * sizeof(T));
+        return column;
+    }
+};
+
+#endif
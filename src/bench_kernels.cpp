@@ -0,0 +1,319 @@
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <string>
+
+#include "generate_image.hpp"
+#include "load_balance.hpp"
+#include "transpose_sort.cpp"
+
+/*
+ * Microbenchmarks of the rendering kernels on fixed synthetic inputs, so a
+ * change to one kernel can be measured without running the whole pipeline.
+ * Every kernel runs in batches until a minimum time has passed; the fastest
+ * batch of several trials is reported as time per operation, operations
+ * per second and bytes touched per operation.
+ */
+
+/**
+ * @brief Keeps the compiler from optimizing away a value.
+ */
+template <typename T>
+inline void keep(const T &value) {
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+/**
+ * @brief Options of the benchmark run.
+ */
+struct BenchOptions {
+    double min_time = 0.2;  ///< Seconds per trial
+    int trials = 5;         ///< Trials per kernel, the fastest is reported
+    std::string filter;     ///< Only run kernels whose name contains this
+};
+
+/**
+ * Times a kernel and prints one line of results.
+ *
+ * @param opt The options of the run.
+ * @param name The name of the kernel.
+ * @param bytes_per_op The bytes read and written by one operation.
+ * @param setup Run before every batch, not timed.
+ * @param batch Runs one batch of the kernel and returns its number of
+ *        operations.
+ */
+void measure(const BenchOptions &opt, const std::string &name,
+             double bytes_per_op, const std::function<void()> &setup,
+             const std::function<size_t()> &batch) {
+    if (name.find(opt.filter) == std::string::npos) return;
+    using clock = std::chrono::steady_clock;
+    double best = 1e300;
+    for (int t = 0; t < opt.trials; t++) {
+        double elapsed = 0;
+        size_t ops = 0;
+        while (elapsed < opt.min_time) {
+            setup();
+            auto start = clock::now();
+            ops += batch();
+            elapsed += std::chrono::duration<double>(clock::now() - start)
+                           .count();
+        }
+        best = min(best, elapsed / ops);
+    }
+    printf("%-26s %10.2f ns/op %10.2f Mop/s %8.0f B/op %8.2f GB/s\n",
+           name.c_str(), best * 1e9, 1e-6 / best, bytes_per_op,
+           bytes_per_op / best * 1e-9);
+}
+
+/**
+ * @brief Fixed synthetic splats in front of the default camera.
+ */
+struct Inputs {
+    Camera cam{1000, 1000, (d_t)M_PI / 2.f};
+    vector<v4_t> rot;       ///< Unit quaternions
+    vector<v3_t> scale;     ///< Scales
+    vector<s3_t> cov;       ///< Covariances from rot and scale
+    vector<v4_t> cam_xyz;   ///< Positions in camera coordinates
+    vector<v4_t> dirs;      ///< Unit view directions
+    vector<ColorHarmonic> colors;
+
+    /**
+     * @param n The number of splats.
+     */
+    explicit Inputs(size_t n) {
+        std::mt19937 rng(1);
+        auto uniform = [&](float lo, float hi) {
+            return lo + (hi - lo) * (rng() >> 8) * 0x1p-24f;
+        };
+        for (size_t i = 0; i < n; i++) {
+            rot.push_back(v4_t{uniform(-1, 1), uniform(-1, 1), uniform(-1, 1),
+                               uniform(-1, 1)}
+                              .normalized());
+            scale.push_back(v3_t{uniform(0.005, 0.02), uniform(0.005, 0.02),
+                                 uniform(0.005, 0.02)});
+            cov.push_back(calc_cov3d(scale.back(), quat_to_mat(rot.back())));
+            cam_xyz.push_back(
+                v4_t{uniform(-1, 1), uniform(-1, 1), uniform(1, 3), 1});
+            dirs.push_back(v4_t{uniform(-1, 1), uniform(-1, 1), uniform(-1, 1),
+                                0}
+                               .normalized());
+            array<v3_t, 16> sh;
+            for (auto &band : sh)
+                band = v3_t{uniform(-1, 1), uniform(-1, 1), uniform(-1, 1)};
+            colors.emplace_back(sh, uniform(0.1, 1));
+        }
+    }
+};
+
+/**
+ * @brief ColorHarmonic::get_color written as an explicit loop over the
+ * channels, with the operations in the same order, as the baseline of its
+ * expression templates. Inline like the member, so that both are inlined
+ * into the timing loop or neither.
+ */
+inline v3_t get_color_loop(const ColorHarmonic &h, const v4_t &dir) {
+    auto &sh = h.sh;
+    d_t x = dir[0], y = dir[1], z = dir[2];
+    v3_t color;
+    for (size_t c = 0; c < 3; c++) {
+        d_t v = sh[0][c];
+        v = v - sh[1][c] * y;
+        v = v + sh[2][c] * z;
+        v = v - sh[3][c] * x;
+        v = v + sh[4][c] * x * y;
+        v = v + sh[5][c] * y * z;
+        v = v + sh[6][c] * ((d_t)2.0 * z * z - x * x - y * y);
+        v = v + sh[7][c] * x * z;
+        v = v + sh[8][c] * (x * x - y * y);
+        v = v + sh[9][c] * y * ((d_t)3.0 * x * x - y * y);
+        v = v + sh[10][c] * x * y * z;
+        v = v + sh[11][c] * y * ((d_t)4.0 * z * z - x * x - y * y);
+        v = v + sh[12][c] * z *
+                    ((d_t)2.0 * z * z - (d_t)3.0 * x * x - (d_t)3.0 * y * y);
+        v = v + sh[13][c] * x * ((d_t)4.0 * z * z - x * x - y * y);
+        v = v + sh[14][c] * z * (x * x - y * y);
+        v = v + sh[15][c] * x * (x * x - (d_t)3.0 * y * y);
+        color[c] = min(max(v + (d_t)0.5, (d_t)0.), (d_t)1.);
+    }
+    return color;
+}
+
+/**
+ * @brief Parses the command line: `--min-time <seconds>`,
+ * `--trials <n>` and `--filter <name part>`.
+ */
+bool parse_options(int argc, char **argv, BenchOptions &opt) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) return false;
+        if (arg == "--min-time") {
+            opt.min_time = std::stod(argv[++i]);
+        } else if (arg == "--trials") {
+            opt.trials = std::stoi(argv[++i]);
+            if (opt.trials < 1) return false;
+        } else if (arg == "--filter") {
+            opt.filter = argv[++i];
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    BenchOptions opt;
+    if (!parse_options(argc, argv, opt)) {
+        fprintf(stderr,
+                "Usage: %s [--min-time <seconds>] [--trials <n>]"
+                " [--filter <name part>]\n",
+                argv[0]);
+        return 1;
+    }
+    const size_t n = 1 << 14;
+    Inputs in(n);
+    auto none = [] {};
+
+    measure(opt, "quat_to_mat+calc_cov3d",
+            sizeof(v4_t) + sizeof(v3_t) + sizeof(s3_t), none, [&] {
+                for (size_t i = 0; i < n; i++)
+                    keep(calc_cov3d(in.scale[i], quat_to_mat(in.rot[i])));
+                return n;
+            });
+
+    measure(opt, "PlotData", sizeof(v4_t) + sizeof(s3_t), none, [&] {
+        for (size_t i = 0; i < n; i++)
+            keep(PlotData(in.cam, in.cam_xyz[i], in.cov[i]));
+        return n;
+    });
+
+    // The expression templates against the same arithmetic written out
+    // per channel; the two should run at the same speed.
+    measure(opt, "get_color/expr", sizeof(ColorHarmonic) + sizeof(v4_t), none,
+            [&] {
+                for (size_t i = 0; i < n; i++)
+                    keep(in.colors[i].get_color(in.dirs[i]));
+                return n;
+            });
+    measure(opt, "get_color/loop", sizeof(ColorHarmonic) + sizeof(v4_t), none,
+            [&] {
+                for (size_t i = 0; i < n; i++)
+                    keep(get_color_loop(in.colors[i], in.dirs[i]));
+                return n;
+            });
+
+    // The blend of draw_gaussian, one operation per pixel.
+    vector<v3_t> rgb(n), color(n);
+    vector<float> mask(n, 1), alpha(n);
+    for (size_t i = 0; i < n; i++) {
+        color[i] = in.colors[i].get_color(in.dirs[i]);
+        alpha[i] = in.colors[i].opacity;
+    }
+    auto clear = [&] { std::fill(rgb.begin(), rgb.end(), v3_t{0, 0, 0}); };
+    size_t blend_bytes = 3 * sizeof(v3_t) + 2 * sizeof(float);
+    measure(opt, "blend/expr", blend_bytes, clear, [&] {
+        for (size_t i = 0; i < n; i++)
+            rgb[i] = rgb[i] + mask[i] * alpha[i] * color[i];
+        return n;
+    });
+    measure(opt, "blend/loop", blend_bytes, clear, [&] {
+        for (size_t i = 0; i < n; i++) {
+            float weight = mask[i] * alpha[i];
+            for (size_t c = 0; c < 3; c++)
+                rgb[i][c] = rgb[i][c] + weight * color[i][c];
+        }
+        return n;
+    });
+
+    // One operation is one blended pixel; the image is reset between
+    // batches so the transmittance does not decay into denormals.
+    Image image;
+    measure(opt, "draw_gaussian/pixel", 2 * (sizeof(v3_t) + sizeof(float)),
+            [&] { image.reset(in.cam); },
+            [&] {
+                size_t pixels = 0;
+                for (size_t i = 0; i < n; i++)
+                    pixels += draw_gaussian(image, in.cam, in.dirs[i],
+                                            in.cam_xyz[i], in.cov[i],
+                                            in.colors[i]);
+                return pixels;
+            });
+
+    vector<v4_t> world_xyz(in.cam_xyz);
+    vector<int> idx(n);
+    measure(opt, "sort_span_in_direction", sizeof(v4_t) + sizeof(int),
+            [&] { std::iota(idx.begin(), idx.end(), 0); },
+            [&] {
+                sort_span_in_direction(world_xyz, v4_t{0, 0, 1, 0}, idx);
+                return n;
+            });
+
+    // Two sorted halves as the odd-even transposition sort sees them.
+    SortEngine<SlabEntry> sorter(0, 2);
+    vector<SlabEntry> mine(n), other(n);
+    for (size_t i = 0; i < n; i++) {
+        mine[i] = {in.cam_xyz[i][2], (int)i, 1};
+        other[i] = {in.cam_xyz[(i * 7) % n][2], (int)(n + i), 1};
+    }
+    std::sort(mine.begin(), mine.end());
+    std::sort(other.begin(), other.end());
+    auto fill = [&] {
+        sorter.mydata = mine;
+        sorter.prepare();
+        sorter.odata = other;
+    };
+    measure(opt, "SortEngine::smallest_half", 2 * sizeof(SlabEntry), fill,
+            [&] {
+                sorter.smallest_half();
+                return n;
+            });
+    measure(opt, "SortEngine::largest_half", 2 * sizeof(SlabEntry), fill,
+            [&] {
+                sorter.largest_half();
+                return n;
+            });
+
+    Image front, behind;
+    front.reset(in.cam);
+    behind.reset(in.cam);
+    for (size_t i = 0; i < n; i += 4)
+        draw_gaussian(behind, in.cam, in.dirs[i], in.cam_xyz[i], in.cov[i],
+                      in.colors[i]);
+    size_t pixels = front.image.size();
+    measure(opt, "Image::combine/pixel", 3 * (sizeof(v3_t) + sizeof(float)),
+            [&] { front.reset(in.cam); },
+            [&] {
+                front.combine(behind);
+                return pixels;
+            });
+
+    // Six cube faces of a small image, so the per-splat work dominates: one
+    // render per view reads the splats six times, render_views once.
+    GaussianData data;
+    data.allocate(n);
+    for (size_t i = 0; i < n; i++)
+        data.set(i, in.cam_xyz[i], in.cov[i], in.colors[i]);
+    vector<Camera> faces;
+    for (int k = 0; k < 6; k++) {
+        faces.emplace_back(64, 64, (d_t)M_PI / 2.f);
+        if (k < 4)
+            faces.back().pan(k * (d_t)M_PI / 2.f);
+        else
+            faces.back().tilt((k == 4 ? 1 : -1) * (d_t)M_PI / 2.f);
+    }
+    size_t splat_bytes = 10 * sizeof(d_t) + 16 * sizeof(v3_t);
+    vector<Image> views(faces.size());
+    RenderScratch scratch;
+    measure(opt, "render/view", n * splat_bytes, none, [&] {
+        for (size_t v = 0; v < faces.size(); v++)
+            render(views[v], faces[v], data, scratch);
+        return faces.size();
+    });
+    MultiViewScratch view_scratch;
+    measure(opt, "render_views/view", n * splat_bytes / faces.size(), none,
+            [&] {
+                render_views(views, faces, data, view_scratch);
+                return faces.size();
+            });
+    return 0;
+}
@@ -0,0 +1,206 @@
+#ifndef BENCHMARK_IMPORT
+#define BENCHMARK_IMPORT 1
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "profile.hpp"
+
+/**
+ * @brief Summary of repeated measurements of one phase.
+ */
+struct PhaseStats {
+    double median = 0, min = 0, max = 0, stddev = 0;
+};
+
+/**
+ * Summarizes repeated measurements.
+ *
+ * @param samples The measurements, at least one.
+ * @return Their median, extremes and sample standard deviation.
+ */
+PhaseStats summarize(std::vector<double> samples) {
+    std::sort(samples.begin(), samples.end());
+    size_t n = samples.size();
+    PhaseStats s;
+    s.min = samples.front();
+    s.max = samples.back();
+    s.median = n % 2 ? samples[n / 2]
+                     : (samples[n / 2 - 1] + samples[n / 2]) / 2;
+    double mean = 0;
+    for (auto v : samples) mean += v;
+    mean /= n;
+    double var = 0;
+    for (auto v : samples) var += (v - mean) * (v - mean);
+    s.stddev = n > 1 ? std::sqrt(var / (n - 1)) : 0;
+    return s;
+}
+
+/**
+ * @brief Sweep parameters of the benchmark mode.
+ */
+struct BenchmarkOptions {
+    std::string output;  ///< JSON lines file, "-" for stdout, empty if off
+    std::vector<int> ranks;  ///< Rank counts to run, all ranks if empty
+    std::vector<std::array<int, 2>> resolutions = {{1000, 1000}};
+    int cameras = 1;  ///< Number of views on an orbit around the scene
+    int camera = -1;  ///< The only view to render, all views if -1
+    int warmup = 1;   ///< Frames rendered before measuring
+    std::vector<std::string> args;  ///< The command line, for the records
+};
+
+/**
+ * Parses a whole command line value as a number.
+ *
+ * @param text The value, for example "12" or "0.5".
+ * @param value Set to the number.
+ * @return true if text was a number with nothing after it.
+ */
+template <typename T>
+bool parse_number(const std::string &text, T &value) {
+    size_t end = 0;
+    try {
+        if constexpr (std::is_integral_v<T>)
+            value = std::stoi(text, &end);
+        else
+            value = (T)std::stod(text, &end);
+    } catch (const std::exception &) {
+        return false;
+    }
+    return end == text.size();
+}
+
+/**
+ * Parses a comma separated list of positive integers.
+ *
+ * @param text The list, for example "1,2,4".
+ * @param values Filled with the integers.
+ * @return true if every entry was a positive integer.
+ */
+bool parse_int_list(const std::string &text, std::vector<int> &values) {
+    values.clear();
+    std::stringstream ss(text);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        size_t end = 0;
+        int v;
+        try {
+            v = std::stoi(item, &end);
+        } catch (const std::exception &) {
+            return false;
+        }
+        if (end != item.size() || v < 1) return false;
+        values.push_back(v);
+    }
+    return !values.empty();
+}
+
+/**
+ * Parses a comma separated list of image sizes.
+ *
+ * @param text The list, for example "1000x1000,1920x1080".
+ * @param sizes Filled with the widths and heights.
+ * @return true if every entry was of the form <width>x<height>.
+ */
+bool parse_resolutions(const std::string &text,
+                       std::vector<std::array<int, 2>> &sizes) {
+    sizes.clear();
+    std::stringstream ss(text);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        auto x = item.find('x');
+        std::vector<int> w, h;
+        if (x == std::string::npos || !parse_int_list(item.substr(0, x), w) ||
+            !parse_int_list(item.substr(x + 1), h) || w.size() != 1 ||
+            h.size() != 1)
+            return false;
+        sizes.push_back({w[0], h[0]});
+    }
+    return !sizes.empty();
+}
+
+/**
+ * @brief Writes a string as a quoted JSON string.
+ */
+void write_json_string(std::ostream &out, const std::string &s) {
+    out << '"';
+    for (char c : s) {
+        if (c == '"' || c == '\\')
+            out << '\\' << c;
+        else if ((unsigned char)c < 0x20)
+            out << ' ';
+        else
+            out << c;
+    }
+    out << '"';
+}
+
+/**
+ * @brief One measured configuration of the benchmark sweep.
+ */
+struct BenchmarkRecord {
+    int ranks = 0;
+    int width = 0, height = 0;
+    int camera = 0;     ///< Index of the view, out of cameras
+    size_t splats = 0;  ///< Splats in the file
+    /// Per measured frame, the spread over the ranks of every phase and
+    /// counter, as returned by RankProfile::gather.
+    std::vector<std::vector<LoadStats>> frames;
+};
+
+/**
+ * Writes a record as one line of JSON.
+ *
+ * The time of a phase in a frame is that of its slowest rank. Every phase
+ * also reports the median over the frames of the mean over the ranks and of
+ * the imbalance ratio (slowest / mean). The work counters are those of the
+ * last frame.
+ *
+ * @param out The stream to write to.
+ * @param bench The sweep parameters, for the warm-up count and arguments.
+ * @param record The measurements.
+ */
+void write_benchmark_record(std::ostream &out, const BenchmarkOptions &bench,
+                            const BenchmarkRecord &record) {
+    out << "{\"args\":[";
+    for (size_t i = 0; i < bench.args.size(); i++) {
+        if (i) out << ',';
+        write_json_string(out, bench.args[i]);
+    }
+    out << "],\"ranks\":" << record.ranks << ",\"width\":" << record.width
+        << ",\"height\":" << record.height << ",\"camera\":" << record.camera
+        << ",\"cameras\":" << bench.cameras << ",\"splats\":" << record.splats
+        << ",\"warmup\":" << bench.warmup
+        << ",\"repetitions\":" << record.frames.size() << ",\"phases\":{";
+    for (int p = 0; p < PhaseTimes::Count; p++) {
+        std::vector<double> slowest, mean, imbalance;
+        for (auto &f : record.frames) {
+            slowest.push_back(f[p].max);
+            mean.push_back(f[p].mean);
+            imbalance.push_back(f[p].imbalance());
+        }
+        auto s = summarize(slowest);
+        out << (p ? "," : "") << '"' << PhaseTimes::names[p] << "\":{"
+            << "\"median\":" << s.median << ",\"min\":" << s.min
+            << ",\"max\":" << s.max << ",\"stddev\":" << s.stddev
+            << ",\"rank_mean\":" << summarize(mean).median
+            << ",\"imbalance\":" << summarize(imbalance).median << '}';
+    }
+    out << "},\"work\":{";
+    for (int c = 0; c < RankProfile::Count; c++) {
+        auto &s = record.frames.back()[PhaseTimes::Count + c];
+        out << (c ? "," : "") << '"' << RankProfile::counter_names[c]
+            << "\":{\"min\":" << s.min << ",\"mean\":" << s.mean
+            << ",\"max\":" << s.max << ",\"max_rank\":" << s.max_rank
+            << ",\"imbalance\":" << s.imbalance() << '}';
+    }
+    out << "}}" << std::endl;
+}
+
+#endif
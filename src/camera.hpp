@@ -134,9 +134,74 @@ struct Camera {
      */
     void move_to(const v4_t &v) { move_to(v3_t{v[0], v[1], v[2]}); }
 
+    /**
+     * @brief Returns a camera with the same pose and field of view but a
+     * different image size.
+     *
+     * @param size_x The width of the new image.
+     * @param size_y The height of the new image.
+     */
+    Camera resized(int size_x, int size_y) const {
+        Camera cam(size_x, size_y, fov_x);
+        cam.r_mat4 = r_mat4;
+        cam.update_matrix();
+        return cam;
+    }
+
+    /**
+     * @brief Returns a camera that renders only the rows [y0, y0 + rows) of
+     * this camera's image, with the same projection.
+     *
+     * @param y0 The first row of the crop.
+     * @param rows The number of rows in the crop.
+     */
+    Camera cropped(int y0, int rows) const {
+        Camera cam = *this;
+        cam.image_size_y = rows;
+        cam.p_mat[1][2] = py - y0;
+        return cam;
+    }
+
     /**
      * @brief Return global position of camera.
      */
     v4_t global_position() const { return r_mat4_T[3]; }
+
+    /**
+     * @brief Returns the camera centre in world coordinates, the point that
+     * r_mat4 maps to the origin.
+     */
+    v4_t center() const {
+        v3_t t{r_mat4[0][3], r_mat4[1][3], r_mat4[2][3]};
+        v3_t c = r_mat3_T.mat_mul(t) * (d_t)-1;
+        return v4_t{c[0], c[1], c[2], 1};
+    }
+};
+
+/**
+ * @brief Pose of a camera looking at a target point from a distance,
+ * turned by yaw around the vertical axis and then by pitch around its own
+ * horizontal axis.
+ */
+struct OrbitPose {
+    v3_t target{0, 0, 0};
+    d_t yaw = 0, pitch = -(d_t)M_PI / 8.f;  ///< In radians
+    d_t distance = 1.5;
+    d_t fov_x = (d_t)M_PI / 2.f;  ///< Horizontal field of view in radians
+
+    /**
+     * @brief Creates the camera of this pose.
+     *
+     * @param size_x The width of the image.
+     * @param size_y The height of the image.
+     */
+    Camera camera(int size_x, int size_y) const {
+        Camera cam(size_x, size_y, fov_x);
+        cam.move_to(target);
+        cam.pan(yaw);
+        cam.tilt(pitch);
+        cam.move_to(v3_t{0, 0, -distance});
+        return cam;
+    }
 };
 #endif
\ No newline at end of file
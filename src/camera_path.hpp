@@ -0,0 +1,113 @@
+#ifndef CAMERA_PATH_IMPORT
+#define CAMERA_PATH_IMPORT 1
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "camera.hpp"
+#include "server.hpp"
+
+/**
+ * @brief Pose between two poses, linear in all parameters.
+ *
+ * @param a The pose at t = 0.
+ * @param b The pose at t = 1.
+ * @param t The position between them.
+ */
+OrbitPose interpolate(const OrbitPose &a, const OrbitPose &b, d_t t) {
+    auto mix = [t](d_t u, d_t v) { return u + (v - u) * t; };
+    OrbitPose p;
+    p.target = v3_t{mix(a.target[0], b.target[0]),
+                    mix(a.target[1], b.target[1]),
+                    mix(a.target[2], b.target[2])};
+    p.yaw = mix(a.yaw, b.yaw);
+    p.pitch = mix(a.pitch, b.pitch);
+    p.distance = mix(a.distance, b.distance);
+    p.fov_x = mix(a.fov_x, b.fov_x);
+    return p;
+}
+
+/**
+ * Reads a camera path.
+ *
+ * Every line is a keyframe in the syntax of parse_view_request, on top of
+ * the previous keyframe (the first on top of defaults), without `output`.
+ * An extra `frames=<n>` pair renders n frames that move linearly from the
+ * previous keyframe to this one, the last of them at this one; the default
+ * of 1 makes the file a plain list of poses. The image size of a keyframe
+ * applies to all of its frames. Empty lines and lines starting with # are
+ * skipped.
+ *
+ * @param file_name The path file.
+ * @param defaults The pose and image size before the first keyframe.
+ * @param frames Filled with one request per frame.
+ * @param error Set to a description of the first error.
+ * @return true if the file was read and held at least one frame.
+ */
+bool read_camera_path(const std::string &file_name,
+                      const ViewRequest &defaults,
+                      std::vector<ViewRequest> &frames, std::string &error) {
+    std::ifstream file(file_name);
+    if (!file) {
+        error = "cannot open " + file_name;
+        return false;
+    }
+    frames.clear();
+    ViewRequest key = defaults;
+    std::string line;
+    for (int line_no = 1; std::getline(file, line); line_no++) {
+        std::stringstream ss(line);
+        std::string item, pose;
+        int n = 1;
+        while (ss >> item) {
+            if (item[0] == '#') break;
+            if (item.rfind("frames=", 0) == 0) {
+                if (sscanf(item.c_str(), "frames=%d", &n) != 1 || n < 1) {
+                    error = "bad value for frames";
+                    n = 0;
+                }
+            } else if (item.rfind("output=", 0) == 0) {
+                error = "output is set by --output";
+                n = 0;
+            } else {
+                pose += item + ' ';
+            }
+        }
+        if (pose.empty() && n == 1) continue;
+        ViewRequest next = key;
+        if (n == 0 || !parse_view_request(pose, next, error)) {
+            error = file_name + ":" + std::to_string(line_no) + ": " + error;
+            return false;
+        }
+        // The first keyframe has no previous one to move from.
+        if (frames.empty()) n = 1;
+        for (int i = 1; i <= n; i++) {
+            ViewRequest frame = next;
+            frame.pose = interpolate(key.pose, next.pose, (d_t)i / n);
+            frames.push_back(frame);
+        }
+        key = next;
+    }
+    if (frames.empty()) error = file_name + " holds no frames";
+    return !frames.empty();
+}
+
+/**
+ * @brief Inserts a frame number before the extension of a file name, as in
+ * frame.bmp -> frame_0012.bmp.
+ */
+std::string numbered_file(const std::string &name, int number) {
+    char digits[16];
+    snprintf(digits, sizeof(digits), "_%04d", number);
+    auto dot = name.rfind('.');
+    auto slash = name.rfind('/');
+    if (dot == std::string::npos ||
+        (slash != std::string::npos && dot < slash))
+        return name + digits;
+    return name.substr(0, dot) + digits + name.substr(dot);
+}
+
+#endif
@@ -4,6 +4,47 @@
 #include "default_types.hpp"
 #include "vec.hpp"
 
+/**
+ * @brief The sum of the spherical harmonics terms in one direction, as a
+ * single expression node.
+ *
+ * Written out as vector operators, the sum is a tree of some forty nodes,
+ * and building it copies every subtree into its parent, which costs more
+ * than the evaluation. This node evaluates each channel in one pass, with
+ * the same operations in the same order as the operators would.
+ */
+struct HarmonicSum : vec_expr<HarmonicSum, d_t, 3> {
+    const array<v3_t, 16> &sh; /**< The scaled coefficients. */
+    d_t x, y, z;               /**< The direction. */
+
+    /**
+     * @brief Constructs the sum of the terms of sh in direction dir.
+     */
+    HarmonicSum(const array<v3_t, 16> &sh, const v4_t &dir)
+        : sh(sh), x(dir[0]), y(dir[1]), z(dir[2]) {}
+
+    d_t operator[](size_t c) const {
+        d_t v = sh[0][c];
+        v = v - sh[1][c] * y;
+        v = v + sh[2][c] * z;
+        v = v - sh[3][c] * x;
+        v = v + sh[4][c] * x * y;
+        v = v + sh[5][c] * y * z;
+        v = v + sh[6][c] * ((d_t)2.0 * z * z - x * x - y * y);
+        v = v + sh[7][c] * x * z;
+        v = v + sh[8][c] * (x * x - y * y);
+        v = v + sh[9][c] * y * ((d_t)3.0 * x * x - y * y);
+        v = v + sh[10][c] * x * y * z;
+        v = v + sh[11][c] * y * ((d_t)4.0 * z * z - x * x - y * y);
+        v = v + sh[12][c] * z *
+                    ((d_t)2.0 * z * z - (d_t)3.0 * x * x - (d_t)3.0 * y * y);
+        v = v + sh[13][c] * x * ((d_t)4.0 * z * z - x * x - y * y);
+        v = v + sh[14][c] * z * (x * x - y * y);
+        v = v + sh[15][c] * x * (x * x - (d_t)3.0 * y * y);
+        return v;
+    }
+};
+
 /**
  * @brief Represents a color defined by spherical harmonics coefficients and opacity.
  */
@@ -11,6 +52,12 @@ struct ColorHarmonic {
     array<v3_t, 16> sh; /**< The spherical harmonics coefficients. */
     d_t opacity; /**< The opacity of the color. */
 
+    /**
+     * @brief Constructs an uninitialised ColorHarmonic, to be filled in from
+     * raw bytes received over MPI.
+     */
+    ColorHarmonic() = default;
+
     /**
      * @brief Constructs a ColorHarmonic object with the given spherical harmonics coefficients and opacity.
      * 
@@ -44,23 +91,7 @@ struct ColorHarmonic {
      * @return The calculated color.
      */
     v3_t get_color(v4_t dir) {
-        v3_t color = sh[0];
-        color = color - sh[1] * dir[1];
-        color = color + sh[2] * dir[2];
-        color = color - sh[3] * dir[0];
-        color = color + sh[4] * dir[0] * dir[1];
-        color = color + sh[5] * dir[1] * dir[2];
-        color = color + sh[6] * ((d_t)2.0 * dir[2] * dir[2] - dir[0] * dir[0] - dir[1] * dir[1]);
-        color = color + sh[7] * dir[0] * dir[2];
-        color = color + sh[8] * (dir[0] * dir[0] - dir[1] * dir[1]);
-        color = color + sh[9] * dir[1] * ((d_t)3.0 * dir[0] * dir[0] - dir[1] * dir[1]);
-        color = color + sh[10] * dir[0] * dir[1] * dir[2];
-        color = color + sh[11] * dir[1] * ((d_t)4.0 * dir[2] * dir[2] - dir[0] * dir[0] - dir[1] * dir[1]);
-        color = color + sh[12] * dir[2] * ((d_t)2.0 * dir[2] * dir[2] - (d_t)3.0 * dir[0] * dir[0] - (d_t)3.0 * dir[1] * dir[1]);
-        color = color + sh[13] * dir[0] * ((d_t)4.0 * dir[2] * dir[2] - dir[0] * dir[0] - dir[1] * dir[1]);
-        color = color + sh[14] * dir[2] * (dir[0] * dir[0] - dir[1] * dir[1]);
-        color = color + sh[15] * dir[0] * (dir[0] * dir[0] - (d_t)3.0 * dir[1] * dir[1]);
-        color = color + (d_t)0.5;
+        v3_t color = HarmonicSum(sh, dir) + (d_t)0.5;
         color[0] = min(max(color[0], (d_t)0.), (d_t)1.);
         color[1] = min(max(color[1], (d_t)0.), (d_t)1.);
         color[2] = min(max(color[2], (d_t)0.), (d_t)1.);
@@ -0,0 +1,274 @@
+#ifndef COMPOSITE_IMPORT
+#define COMPOSITE_IMPORT 1
+
+#include <mpi.h>
+
+#include <string>
+
+#include "generate_image.hpp"
+#include "trace.hpp"
+
+/**
+ * @brief Available backends for compositing the per-rank images.
+ */
+enum class CompositeMode {
+    Tree,           ///< Hand-rolled binary tree of send/recv pairs
+    Reduce,         ///< MPI_Reduce with the "over" operator
+    ReduceScatter,  ///< MPI_Reduce_scatter_block, then gather to the root
+    Shared          ///< Shared-memory blend per node, then MPI_Reduce
+};
+
+/**
+ * @brief Parses a composite mode from its command line name.
+ *
+ * @param name One of "tree", "reduce", "reduce_scatter" or "shared".
+ * @param mode Set to the parsed mode on success.
+ * @return true if the name was recognised.
+ */
+bool parse_composite_mode(const std::string &name, CompositeMode &mode) {
+    if (name == "tree")
+        mode = CompositeMode::Tree;
+    else if (name == "reduce")
+        mode = CompositeMode::Reduce;
+    else if (name == "reduce_scatter")
+        mode = CompositeMode::ReduceScatter;
+    else if (name == "shared")
+        mode = CompositeMode::Shared;
+    else
+        return false;
+    return true;
+}
+
+static_assert(sizeof(v4_t) == 4 * sizeof(float), "v4_t must be packed RGBA");
+
+/**
+ * Blends an RGBA pixel behind an accumulated front pixel, in place.
+ *
+ * @param front The accumulated pixel closer to the camera.
+ * @param behind The pixel behind it.
+ */
+inline void blend_behind(v4_t &front, const v4_t &behind) {
+    for (int c = 0; c < 3; c++) front[c] += behind[c] * front[3];
+    front[3] *= behind[3];
+}
+
+/**
+ * MPI user function blending RGBA pixels front to back.
+ *
+ * For a non-commutative operator MPI passes the operand of the lower rank as
+ * `in`, and lower ranks hold the slabs closer to the camera. The result is
+ * therefore `in` over `inout`, the same blend as Image::combine.
+ */
+void over_op(void *in, void *inout, int *len, MPI_Datatype *) {
+    auto front = static_cast<const v4_t *>(in);
+    auto behind = static_cast<v4_t *>(inout);
+    for (int i = 0; i < *len; i++) {
+        for (int c = 0; c < 3; c++)
+            behind[i][c] = front[i][c] + behind[i][c] * front[i][3];
+        behind[i][3] *= front[i][3];
+    }
+}
+
+/**
+ * @brief Composites images with MPI collectives and a user-defined "over"
+ * operator, so the MPI library is free to pick the reduction algorithm.
+ *
+ * Owns the RGBA datatype and operator, so it must be created after MPI_Init
+ * and destroyed before MPI_Finalize.
+ */
+struct OverReducer {
+    MPI_Datatype rgba;
+    MPI_Op over;
+    vector<v4_t> send_buf, recv_buf;
+
+    OverReducer() {
+        MPI_Type_contiguous(4, MPI_FLOAT, &rgba);
+        MPI_Type_commit(&rgba);
+        MPI_Op_create(&over_op, 0, &over);
+    }
+
+    ~OverReducer() {
+        MPI_Op_free(&over);
+        MPI_Type_free(&rgba);
+    }
+
+    OverReducer(const OverReducer &) = delete;
+    OverReducer &operator=(const OverReducer &) = delete;
+
+    /**
+     * @brief Reduces all images into the image on the root rank.
+     *
+     * @param image The local image, replaced by the composite on the root.
+     * @param comm The communicator, ranked front to back.
+     * @param root The rank receiving the composite.
+     */
+    void reduce(Image &image, MPI_Comm comm, int root = 0) {
+        TRACE_SCOPE("OverReducer::reduce");
+        int rank;
+        MPI_Comm_rank(comm, &rank);
+        image.to_rgba(send_buf);
+        if (rank == root) {
+            MPI_Reduce(MPI_IN_PLACE, send_buf.data(), send_buf.size(), rgba,
+                       over, root, comm);
+            image.from_rgba(send_buf);
+        } else {
+            MPI_Reduce(send_buf.data(), nullptr, send_buf.size(), rgba, over,
+                       root, comm);
+        }
+    }
+
+    /**
+     * @brief Reduces the images so that every rank owns one composited block
+     * of pixels.
+     *
+     * The image is padded with transparent pixels up to a multiple of the
+     * communicator size.
+     *
+     * @param image The local image.
+     * @param comm The communicator, ranked front to back.
+     * @return The number of pixels in each block; block i starts at pixel
+     *         i * block and is left in recv_buf on rank i.
+     */
+    int reduce_scatter(const Image &image, MPI_Comm comm) {
+        TRACE_SCOPE("OverReducer::reduce_scatter");
+        int size;
+        MPI_Comm_size(comm, &size);
+        image.to_rgba(send_buf);
+        int block = (send_buf.size() + size - 1) / size;
+        send_buf.resize(block * size, v4_t{0, 0, 0, 1});
+        recv_buf.resize(block);
+        MPI_Reduce_scatter_block(send_buf.data(), recv_buf.data(), block, rgba,
+                                 over, comm);
+        return block;
+    }
+
+    /**
+     * @brief Reduces with reduce_scatter and gathers the blocks into the
+     * image on the root rank.
+     *
+     * @param image The local image, replaced by the composite on the root.
+     * @param comm The communicator, ranked front to back.
+     * @param root The rank receiving the composite.
+     */
+    void reduce_scatter_gather(Image &image, MPI_Comm comm, int root = 0) {
+        TRACE_SCOPE("OverReducer::reduce_scatter_gather");
+        int block = reduce_scatter(image, comm);
+        MPI_Gather(recv_buf.data(), block, rgba, send_buf.data(), block, rgba,
+                   root, comm);
+        int rank;
+        MPI_Comm_rank(comm, &rank);
+        if (rank == root) image.from_rgba(send_buf);
+    }
+};
+
+/**
+ * @brief Hierarchical compositor that blends the images of the ranks sharing
+ * a node through an MPI shared-memory window, so that only one image per
+ * node takes part in the inter-node reduction.
+ *
+ * Every rank packs its image into its own segment of the window. Each node
+ * rank then blends one horizontal slice of all segments in place into the
+ * segment of the node leader, which finally reduces with the other leaders.
+ * This is only valid when the ranks of a node are consecutive in the
+ * communicator; otherwise every rank falls back to a flat MPI_Reduce.
+ */
+struct SharedCompositor {
+    MPI_Comm comm, node_comm, leader_comm = MPI_COMM_NULL;
+    MPI_Win win;
+    vector<v4_t *> segments;  ///< Base pointer of each node rank's segment
+    int node_rank, node_size;
+    size_t n_pixels;
+    bool hierarchical;
+
+    /**
+     * @brief Splits the communicator by node and allocates the window.
+     *
+     * @param comm_ The communicator, ranked front to back.
+     * @param n_pixels_ The number of pixels of each image.
+     */
+    SharedCompositor(MPI_Comm comm_, size_t n_pixels_)
+        : comm(comm_), n_pixels(n_pixels_) {
+        int rank;
+        MPI_Comm_rank(comm, &rank);
+        MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL,
+                            &node_comm);
+        MPI_Comm_rank(node_comm, &node_rank);
+        MPI_Comm_size(node_comm, &node_size);
+
+        int lo, hi, local_ok, all_ok;
+        MPI_Allreduce(&rank, &lo, 1, MPI_INT, MPI_MIN, node_comm);
+        MPI_Allreduce(&rank, &hi, 1, MPI_INT, MPI_MAX, node_comm);
+        local_ok = hi - lo + 1 == node_size;
+        MPI_Allreduce(&local_ok, &all_ok, 1, MPI_INT, MPI_LAND, comm);
+        hierarchical = all_ok;
+
+        MPI_Comm_split(comm, node_rank == 0 ? 0 : MPI_UNDEFINED, rank,
+                       &leader_comm);
+
+        v4_t *base;
+        MPI_Win_allocate_shared(n_pixels * sizeof(v4_t), sizeof(v4_t),
+                                MPI_INFO_NULL, node_comm, &base, &win);
+        segments.resize(node_size);
+        for (int r = 0; r < node_size; r++) {
+            MPI_Aint seg_size;
+            int disp_unit;
+            MPI_Win_shared_query(win, r, &seg_size, &disp_unit, &segments[r]);
+        }
+        MPI_Win_lock_all(MPI_MODE_NOCHECK, win);
+    }
+
+    ~SharedCompositor() {
+        MPI_Win_unlock_all(win);
+        MPI_Win_free(&win);
+        if (leader_comm != MPI_COMM_NULL) MPI_Comm_free(&leader_comm);
+        MPI_Comm_free(&node_comm);
+    }
+
+    SharedCompositor(const SharedCompositor &) = delete;
+    SharedCompositor &operator=(const SharedCompositor &) = delete;
+
+    /**
+     * @brief Makes the stores of all node ranks visible to each other.
+     */
+    void node_sync() {
+        MPI_Win_sync(win);
+        MPI_Barrier(node_comm);
+        MPI_Win_sync(win);
+    }
+
+    /**
+     * @brief Composites all images into the image on rank 0 of the
+     * communicator.
+     *
+     * @param image The local image, replaced by the composite on rank 0.
+     * @param reducer The reducer used between nodes.
+     */
+    void composite(Image &image, OverReducer &reducer) {
+        TRACE_SCOPE("SharedCompositor::composite");
+        if (!hierarchical) {
+            reducer.reduce(image, comm);
+            return;
+        }
+        image.to_rgba(std::span<v4_t>(segments[node_rank], n_pixels));
+        node_sync();
+
+        size_t slice = (n_pixels + node_size - 1) / node_size;
+        size_t start = min(n_pixels, node_rank * slice);
+        size_t end = min(n_pixels, start + slice);
+        v4_t *front = segments[0];
+        for (int r = 1; r < node_size; r++) {
+            const v4_t *behind = segments[r];
+            for (size_t idx = start; idx < end; idx++)
+                blend_behind(front[idx], behind[idx]);
+        }
+        node_sync();
+
+        if (leader_comm == MPI_COMM_NULL) return;
+        image.from_rgba(std::span<const v4_t>(front, n_pixels));
+        int n_leaders;
+        MPI_Comm_size(leader_comm, &n_leaders);
+        if (n_leaders > 1) reducer.reduce(image, leader_comm);
+    }
+};
+
+#endif
\ No newline at end of file
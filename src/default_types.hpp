@@ -7,4 +7,5 @@ using v3_t = vec<d_t, 3>;
 using m3_t = mat<d_t, 3, 3>;
 using v4_t = vec<d_t, 4>;
 using m4_t = mat<d_t, 4, 4>;
+using s3_t = sym3<d_t>;
 #endif
\ No newline at end of file
@@ -0,0 +1,141 @@
+#ifndef FRAME_BUDGET_IMPORT
+#define FRAME_BUDGET_IMPORT 1
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <deque>
+#include <vector>
+
+#include "generate_image.hpp"
+
+/**
+ * @brief Picks the render resolution of every frame so that the frame time
+ * stays under a target.
+ *
+ * The render and compositing time of the slowest rank is modelled as
+ * fixed + per_pixel * pixels, fitted by least squares to the last frames;
+ * the rest of the frame (loading, sorting) is taken as its recent average.
+ * The next frame gets the largest scale, per axis and at most 1, whose
+ * predicted time fits the budget with a safety margin.
+ */
+struct FrameBudget {
+    static constexpr int window = 8;         ///< Frames the model is fitted to
+    static constexpr double margin = 0.9;    ///< Part of the budget planned
+    static constexpr double min_scale = 0.25;
+
+    double scale = 1;         ///< Per-axis scale of the next frame
+    double predicted_ms = 0;  ///< Predicted time of the next frame, 0 if none
+    std::deque<std::array<double, 2>> samples;  ///< Pixels, render + comm ms
+    double other_ms = 0;      ///< Average time outside render and comm
+
+    /**
+     * @brief The render size of the next frame.
+     *
+     * @param width, height The size of the output image.
+     * @param w, h Set to the size to render at.
+     */
+    void size(int width, int height, int &w, int &h) const {
+        w = std::max(1, (int)std::lround(width * scale));
+        h = std::max(1, (int)std::lround(height * scale));
+    }
+
+    /**
+     * Records a frame and picks the scale of the next one. Every rank must
+     * pass the same values, so that all of them pick the same scale.
+     *
+     * @param target_ms The frame time budget.
+     * @param pixels The pixels rendered in the frame.
+     * @param full_pixels The pixels of the output image.
+     * @param render_comm_ms The render plus compositing time of the slowest
+     *        rank.
+     * @param frame_ms The frame time of the slowest rank.
+     */
+    void update(double target_ms, double pixels, double full_pixels,
+                double render_comm_ms, double frame_ms) {
+        double other = std::max(0.0, frame_ms - render_comm_ms);
+        other_ms = samples.empty() ? other : (other_ms + other) / 2;
+        samples.push_back({pixels, render_comm_ms});
+        if ((int)samples.size() > window) samples.pop_front();
+
+        // Least squares fit; with too little spread in the pixel counts the
+        // whole time is taken as proportional to the pixels, which
+        // overestimates what a smaller frame saves, and the next frames
+        // then correct the fit.
+        double n = samples.size(), sp = 0, st = 0, spp = 0, spt = 0;
+        for (auto [p, t] : samples) {
+            sp += p, st += t;
+            spp += p * p, spt += p * t;
+        }
+        double var = spp - sp * sp / n;
+        double per_pixel = st / sp, fixed = 0;
+        if (var > 1e-3 * spp) {
+            per_pixel = (spt - sp * st / n) / var;
+            fixed = (st - per_pixel * sp) / n;
+            if (per_pixel <= 0 || fixed < 0) {
+                per_pixel = st / sp;
+                fixed = 0;
+            }
+        }
+
+        double available = target_ms * margin - other_ms - fixed;
+        double next = available > 0
+                          ? std::sqrt(available / per_pixel / full_pixels)
+                          : min_scale;
+        next = std::clamp(next, min_scale, 1.0);
+        // Small changes are not worth the jitter of resizing.
+        if (std::abs(next - scale) > 0.02 || next == 1 || next == min_scale)
+            scale = next;
+        predicted_ms =
+            other_ms + fixed + per_pixel * full_pixels * scale * scale;
+    }
+};
+
+/**
+ * Upscales an image with separable linear interpolation: the rows into a
+ * scratch buffer, then the columns. Pixel centres are aligned, so the
+ * corners of both images coincide.
+ *
+ * @param src The image to upscale, with its background already added.
+ * @param dst Set to the upscaled colours; its alpha mask is 0.
+ * @param w, h The size of the upscaled image.
+ * @param rows Scratch buffer of src.h * w colours.
+ */
+void upscale(const Image &src, Image &dst, int w, int h,
+             std::vector<v3_t> &rows) {
+    struct Tap {
+        int i0, i1;
+        float t;
+    };
+    auto taps = [](int from, int to) {
+        std::vector<Tap> taps(to);
+        for (int i = 0; i < to; i++) {
+            float s = std::clamp((i + 0.5f) * from / to - 0.5f, 0.f,
+                                 (float)(from - 1));
+            int i0 = (int)s;
+            taps[i] = {i0, std::min(i0 + 1, from - 1), s - i0};
+        }
+        return taps;
+    };
+    auto tx = taps(src.w, w), ty = taps(src.h, h);
+
+    rows.resize(src.h * w);
+    for (int y = 0; y < src.h; y++) {
+        const v3_t *in = &src.image[y * src.w];
+        for (int x = 0; x < w; x++) {
+            auto [x0, x1, t] = tx[x];
+            rows[y * w + x] = in[x0] * (1 - t) + in[x1] * t;
+        }
+    }
+    dst.w = w, dst.h = h;
+    dst.image.resize(w * h);
+    dst.alpha_mask.assign(w * h, 0);
+    for (int y = 0; y < h; y++) {
+        auto [y0, y1, t] = ty[y];
+        for (int x = 0; x < w; x++)
+            dst.image[y * w + x] =
+                rows[y0 * w + x] * (1 - t) + rows[y1 * w + x] * t;
+    }
+}
+
+#endif
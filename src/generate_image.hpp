@@ -1,3 +1,6 @@
+#ifndef GENERATE_IMAGE_IMPORT
+#define GENERATE_IMAGE_IMPORT 1
+
 #include <algorithm>
 #include <cmath>
 #include <iostream>
@@ -8,7 +11,11 @@
 #include <vector>
 
 #include "../happly/happly.h"
+#include "arena.hpp"
+#include "image_format.hpp"
 #include "include.hpp"
+#include "morton.hpp"
+#include "quad_tree.h"
 
 #define DEBUG 1
 
@@ -19,12 +26,192 @@
 #endif
 
 /**
- * @brief Struct representing Gaussian data.
+ * @brief Raw view of one column of GaussianData, for moving whole splats
+ * between ranks without knowing the column types.
+ */
+struct RawColumn {
+    std::byte *data;   ///< First byte of the column
+    size_t elem_size;  ///< Size of one element in bytes
+};
+
+/**
+ * @brief The vertex properties of a parsed PLY file, read in place.
+ *
+ * happly's getProperty copies a whole column on every call; this keeps
+ * pointers to the columns the parsed file already holds, so decoding a
+ * splat allocates nothing. The properties must be stored as float, as in
+ * the files written by the training code and by generate_scene.
+ */
+struct PlyColumns {
+    static constexpr size_t bands = 16;
+    const float *x, *y, *z, *opacity;
+    array<const float *, 4> rot;
+    array<const float *, 3> scale;
+    /// f_dc and f_rest by band and channel, nullptr for bands not in the file
+    array<array<const float *, 3>, bands> sh{};
+
+    explicit PlyColumns(happly::PLYData &ply_data) {
+        auto &vertex = ply_data.getElement("vertex");
+        auto column = [&vertex](const std::string &name) {
+            auto typed = dynamic_cast<happly::TypedProperty<float> *>(
+                vertex.getPropertyPtr(name).get());
+            if (!typed)
+                throw std::runtime_error("PLY property " + name +
+                                         " is not float");
+            return typed->data.data();
+        };
+        x = column("x"), y = column("y"), z = column("z");
+        opacity = column("opacity");
+        for (int k = 0; k < 4; k++) rot[k] = column("rot_" + std::to_string(k));
+        for (int k = 0; k < 3; k++)
+            scale[k] = column("scale_" + std::to_string(k));
+        for (int c = 0; c < 3; c++)
+            sh[0][c] = column("f_dc_" + std::to_string(c));
+        // Files of a spherical harmonics degree below 3 have fewer f_rest
+        // properties, stored channel by channel; the missing bands are zero.
+        size_t stored = 0;
+        while (stored < 3 * (bands - 1) &&
+               vertex.hasProperty("f_rest_" + std::to_string(stored)))
+            stored++;
+        for (size_t b = 1; b < 1 + stored / 3; b++)
+            for (size_t c = 0; c < 3; c++)
+                sh[b][c] = column("f_rest_" +
+                                  std::to_string(b - 1 + stored / 3 * c));
+    }
+
+    /**
+     * @brief Position of element i in homogeneous coordinates.
+     */
+    v4_t position(size_t i) const { return v4_t{x[i], y[i], z[i], 1}; }
+
+    /**
+     * @brief Covariance of element i, from its rotation and log scales.
+     */
+    s3_t covariance(size_t i) const {
+        m3_t rot_mat = quat_to_mat(
+            v4_t{rot[0][i], rot[1][i], rot[2][i], rot[3][i]}.normalized());
+        return calc_cov3d(
+            exp(v3_t{scale[0][i], scale[1][i], scale[2][i]}).eval(), rot_mat);
+    }
+
+    /**
+     * @brief Opacity of element i, after the sigmoid activation.
+     */
+    d_t activated_opacity(size_t i) const {
+        return 1.0f / (1.0f + std::exp(-opacity[i]));
+    }
+
+    /**
+     * @brief Colour of element i, with the bands scaled by ColorHarmonic.
+     */
+    ColorHarmonic color(size_t i) const {
+        array<v3_t, bands> c;
+        for (size_t b = 0; b < bands; b++)
+            c[b] = sh[b][0] ? v3_t{sh[b][0][i], sh[b][1][i], sh[b][2][i]}
+                            : v3_t{0, 0, 0};
+        return ColorHarmonic(c, activated_opacity(i));
+    }
+};
+
+/**
+ * @brief Buffers of GaussianData::load_data, kept between loads so that a
+ * reload of a slab no larger than the last one allocates nothing.
+ */
+struct LoadScratch {
+    vector<v4_t> xyz;                        ///< Positions in el order
+    vector<int> order;                       ///< Storage order of the splats
+    vector<std::pair<uint64_t, int>> keys;   ///< Morton codes
+};
+
+/**
+ * @brief Struct representing Gaussian data, stored as a structure of arrays.
+ *
+ * Every attribute is its own 64-byte aligned column, carved out of a single
+ * arena allocation per rank: x/y/z, the six unique covariance terms,
+ * opacity and one column per spherical harmonics band (already scaled by
+ * the basis constants, as in ColorHarmonic).
  */
 struct GaussianData {
-    std::vector<v4_t> xyz;              ///< Vector of 4D positions
-    std::vector<m3_t> cov3d;            ///< Vector of 3x3 covariance matrices
-    std::vector<ColorHarmonic> colors;  ///< Vector of color harmonics
+    size_t n = 0;                       ///< Number of splats
+    Arena arena;                        ///< Backing storage of all columns
+    std::span<d_t> x, y, z;             ///< Positions
+    array<std::span<d_t>, 6> cov;       ///< Covariance xx, xy, xz, yy, yz, zz
+    std::span<d_t> opacity;             ///< Opacities
+    array<std::span<v3_t>, 16> sh;      ///< Spherical harmonics bands
+
+    /**
+     * @brief Number of splats.
+     */
+    size_t size() const { return n; }
+
+    /**
+     * @brief Sizes the arena for n splats and carves out all columns. The
+     * previous contents are lost.
+     * @param n_ The number of splats.
+     */
+    void allocate(size_t n_) {
+        n = n_;
+        arena.reserve(Arena::padded(n * sizeof(d_t)) * 10 +
+                      Arena::padded(n * sizeof(v3_t)) * 16);
+        x = arena.alloc<d_t>(n);
+        y = arena.alloc<d_t>(n);
+        z = arena.alloc<d_t>(n);
+        for (auto &c : cov) c = arena.alloc<d_t>(n);
+        opacity = arena.alloc<d_t>(n);
+        for (auto &band : sh) band = arena.alloc<v3_t>(n);
+    }
+
+    /**
+     * @brief All columns as raw bytes, in a fixed order.
+     */
+    array<RawColumn, 26> raw_columns() {
+        array<RawColumn, 26> columns;
+        size_t c = 0;
+        for (auto col : {x, y, z, cov[0], cov[1], cov[2], cov[3], cov[4],
+                         cov[5], opacity})
+            columns[c++] = {(std::byte *)col.data(), sizeof(d_t)};
+        for (auto band : sh)
+            columns[c++] = {(std::byte *)band.data(), sizeof(v3_t)};
+        return columns;
+    }
+
+    /**
+     * @brief Position of splat i in homogeneous coordinates.
+     */
+    v4_t position(size_t i) const { return v4_t{x[i], y[i], z[i], 1}; }
+
+    /**
+     * @brief Symmetric covariance matrix of splat i.
+     */
+    s3_t covariance(size_t i) const {
+        return s3_t{cov[0][i], cov[1][i], cov[2][i],
+                    cov[3][i], cov[4][i], cov[5][i]};
+    }
+
+    /**
+     * @brief Colour of splat i, with the stored bands copied as they are.
+     */
+    ColorHarmonic color(size_t i) const {
+        ColorHarmonic c;
+        for (size_t b = 0; b < sh.size(); b++) c.sh[b] = sh[b][i];
+        c.opacity = opacity[i];
+        return c;
+    }
+
+    /**
+     * @brief Stores one splat.
+     * @param i The index of the splat.
+     * @param pos The position.
+     * @param cov3d The symmetric covariance matrix.
+     * @param color The colour, with already scaled bands.
+     */
+    void set(size_t i, const v4_t &pos, const s3_t &cov3d,
+             const ColorHarmonic &color) {
+        x[i] = pos[0], y[i] = pos[1], z[i] = pos[2];
+        for (size_t k = 0; k < cov.size(); k++) cov[k][i] = cov3d[k];
+        opacity[i] = color.opacity;
+        for (size_t b = 0; b < sh.size(); b++) sh[b][i] = color.sh[b];
+    }
 
     /**
      * @brief Get the size of the Gaussian data.
@@ -43,125 +230,117 @@ struct GaussianData {
      */
     static std::vector<v4_t> load_xyz(happly::PLYData &ply_data,
                                       std::span<int> el) {
-        std::vector<d_t> x =
-            ply_data.getElement("vertex").getProperty<float>("x");
-        std::vector<d_t> y =
-            ply_data.getElement("vertex").getProperty<float>("y");
-        std::vector<d_t> z =
-            ply_data.getElement("vertex").getProperty<float>("z");
-
+        PlyColumns file(ply_data);
         std::vector<v4_t> result;
-
-        for (auto i : el) {
-            result.emplace_back(v4_t{x[i], y[i], z[i], 1});
-        }
+        result.reserve(el.size());
+        for (auto i : el) result.push_back(file.position(i));
         return result;
     }
 
     /**
-     * @brief Load the 3D covariance matrices from the PLY data.
+     * @brief Load the Gaussian data from the PLY data.
+     *
+     * By default the splats are stored in Morton order of their positions
+     * rather than in the order of el, so that splats that are near in space,
+     * and therefore near in any depth order, are also near in memory.
+     *
      * @param ply_data The PLY data object.
      * @param el The indices of the elements to load.
-     * @return The vector of 3D covariance matrices.
-     */
-    static std::vector<m3_t> load_cov3d(happly::PLYData &ply_data,
-                                        std::span<int> el) {
-        std::vector<d_t> rot_x =
-            ply_data.getElement("vertex").getProperty<float>("rot_0");
-        std::vector<d_t> rot_y =
-            ply_data.getElement("vertex").getProperty<float>("rot_1");
-        std::vector<d_t> rot_z =
-            ply_data.getElement("vertex").getProperty<float>("rot_2");
-        std::vector<d_t> rot_w =
-            ply_data.getElement("vertex").getProperty<float>("rot_3");
-
-        std::vector<d_t> scale_0 =
-            ply_data.getElement("vertex").getProperty<float>("scale_0");
-        std::vector<d_t> scale_1 =
-            ply_data.getElement("vertex").getProperty<float>("scale_1");
-        std::vector<d_t> scale_2 =
-            ply_data.getElement("vertex").getProperty<float>("scale_2");
-
-        std::vector<m3_t> result;
-
-        for (auto i : el) {
-            m3_t rot_mat = quat_to_mat(
-                v4_t{rot_x[i], rot_y[i], rot_z[i], rot_w[i]}.normalized());
-            result.emplace_back(calc_cov3d(
-                exp(v3_t{scale_0[i], scale_1[i], scale_2[i]}), rot_mat));
+     * @param spatial Store the splats in Morton order instead of el order.
+     * @param scratch The order buffers, reused between loads.
+     */
+    void load_data(happly::PLYData &ply_data, const std::span<int> &el,
+                   bool spatial, LoadScratch &scratch) {
+        PlyColumns file(ply_data);
+        auto &xyz = scratch.xyz;
+        xyz.resize(el.size());
+        for (size_t i = 0; i < el.size(); i++) xyz[i] = file.position(el[i]);
+        auto &order = scratch.order;
+        order.resize(el.size());
+        if (spatial)
+            morton_order(xyz, order, scratch.keys);
+        else
+            std::iota(order.begin(), order.end(), 0);
+        allocate(el.size());
+        for (size_t i = 0; i < n; i++) {
+            int k = el[order[i]];
+            set(i, xyz[order[i]], file.covariance(k), file.color(k));
         }
-        return result;
     }
 
     /**
-     * @brief Load the colors from the PLY data.
-     * @param ply_data The PLY data object.
-     * @param el The indices of the elements to load.
-     * @return The vector of color harmonics.
-     */
-    static std::vector<ColorHarmonic> load_colors(happly::PLYData &ply_data,
-                                                  std::span<int> el) {
-        // Load opacity
-        std::vector<d_t> opacity =
-            ply_data.getElement("vertex").getProperty<float>("opacity");
-
-        // Load feature data
-        size_t extra_features = 45;
-        std::vector<std::vector<d_t>> features;  // Maybe some other shape here?
-        features.push_back(
-            ply_data.getElement("vertex").getProperty<float>("f_dc_0"));
-        features.push_back(
-            ply_data.getElement("vertex").getProperty<float>("f_dc_1"));
-        features.push_back(
-            ply_data.getElement("vertex").getProperty<float>("f_dc_2"));
-        for (size_t i = 0; i < extra_features / 3; i++) {
-            for (size_t j = 0; j < 3; j++) {
-                size_t ind_file = i + extra_features / 3 * j;
-                features.push_back(
-                    ply_data.getElement("vertex").getProperty<float>(
-                        "f_rest_" + std::to_string(ind_file)));
-            }
-        }
+     * @brief Load the Gaussian data from the PLY data, with buffers of its
+     * own.
+     */
+    void load_data(happly::PLYData &ply_data, const std::span<int> &el,
+                   bool spatial = true) {
+        LoadScratch scratch;
+        load_data(ply_data, el, spatial, scratch);
+    }
 
-        std::vector<ColorHarmonic> result;
-        for (auto i : el) {
-            array<v3_t, 16> c;
-            for (size_t f_i = 0; f_i < (3 + extra_features); f_i += 3) {
-                c[f_i / 3] = v3_t{features[f_i][i], features[f_i + 1][i],
-                                  features[f_i + 2][i]};
-            }
-            result.emplace_back(ColorHarmonic(
-                std::move(c), 1.0f / (1.0f + std::exp(-opacity[i]))));
-        }
+    /**
+     * @brief Positions of some splats of already decoded data.
+     * @param src The decoded splats.
+     * @param el The indices of the splats in src.
+     */
+    static std::vector<v4_t> load_xyz(const GaussianData &src,
+                                      std::span<int> el) {
+        std::vector<v4_t> result;
+        result.reserve(el.size());
+        for (auto i : el) result.push_back(src.position(i));
         return result;
     }
 
     /**
-     * @brief Load the Gaussian data from the PLY data.
-     * @param ply_data The PLY data object.
-     * @param el The indices of the elements to load.
+     * @brief Copies some splats of already decoded data, as load_data does
+     * from the PLY data but without decoding the file again.
+     * @param src The decoded splats.
+     * @param el The indices of the splats in src.
+     * @param spatial Store the splats in Morton order instead of el order.
+     * @param scratch The position and order buffers, reused between loads.
+     */
+    void load_data(const GaussianData &src, const std::span<int> &el,
+                   bool spatial, LoadScratch &scratch) {
+        auto &xyz = scratch.xyz;
+        xyz.resize(el.size());
+        for (size_t i = 0; i < el.size(); i++) xyz[i] = src.position(el[i]);
+        auto &order = scratch.order;
+        order.resize(el.size());
+        if (spatial)
+            morton_order(xyz, order, scratch.keys);
+        else
+            std::iota(order.begin(), order.end(), 0);
+        allocate(el.size());
+        for (size_t i = 0; i < n; i++) {
+            int k = el[order[i]];
+            set(i, xyz[order[i]], src.covariance(k), src.color(k));
+        }
+    }
+
+    /**
+     * @brief Copies some splats of already decoded data, with buffers of
+     * its own.
      */
-    void load_data(happly::PLYData &ply_data, const std::span<int> &el) {
-        xyz = load_xyz(ply_data, el);
-        cov3d = load_cov3d(ply_data, el);
-        colors = load_colors(ply_data, el);
+    void load_data(const GaussianData &src, const std::span<int> &el,
+                   bool spatial = true) {
+        LoadScratch scratch;
+        load_data(src, el, spatial, scratch);
     }
 
     /**
      * @brief Load test data for the Gaussian data.
      */
     void load_test() {
-        xyz = {v4_t{0, 0, 0, 1}, v4_t{1, 0, 0, 1}, v4_t{0, 1, 0, 1},
-               v4_t{0, 0, -1, 1}};
-        cov3d = {
-            calc_cov3d(v3_t{0.03, 0.03, 0.03}, quat_to_mat(v4_t{1, 0, 0, 0})),
-            calc_cov3d(v3_t{0.2, 0.03, 0.03}, quat_to_mat(v4_t{1, 0, 0, 0})),
-            calc_cov3d(v3_t{0.03, 0.2, 0.03}, quat_to_mat(v4_t{1, 0, 0, 0})),
-            calc_cov3d(v3_t{0.03, 0.03, 0.2}, quat_to_mat(v4_t{1, 0, 0, 0}))};
-        colors = {ColorHarmonic(array<v3_t, 16>{1, 0, 1}, 1.f),
-                  ColorHarmonic(array<v3_t, 16>{1, 0, 0}, 1.f),
-                  ColorHarmonic(array<v3_t, 16>{0, 1, 0}, 1.f),
-                  ColorHarmonic(array<v3_t, 16>{0, 1, 1}, 1.f)};
+        allocate(4);
+        auto rot = quat_to_mat(v4_t{1, 0, 0, 0});
+        set(0, v4_t{0, 0, 0, 1}, calc_cov3d(v3_t{0.03, 0.03, 0.03}, rot),
+            ColorHarmonic(array<v3_t, 16>{1, 0, 1}, 1.f));
+        set(1, v4_t{1, 0, 0, 1}, calc_cov3d(v3_t{0.2, 0.03, 0.03}, rot),
+            ColorHarmonic(array<v3_t, 16>{1, 0, 0}, 1.f));
+        set(2, v4_t{0, 1, 0, 1}, calc_cov3d(v3_t{0.03, 0.2, 0.03}, rot),
+            ColorHarmonic(array<v3_t, 16>{0, 1, 0}, 1.f));
+        set(3, v4_t{0, 0, -1, 1}, calc_cov3d(v3_t{0.03, 0.03, 0.2}, rot),
+            ColorHarmonic(array<v3_t, 16>{0, 1, 1}, 1.f));
     }
 };
 
@@ -219,22 +398,104 @@ vector<int> sort_positions_in_direction(const vector<v4_t> &pos,
     return idx;
 }
 
+/**
+ * @brief Per-frame scratch buffers of render, kept between frames so that
+ * their storage is reused.
+ */
+struct RenderScratch {
+    vector<v4_t> trans_xyz;  ///< Positions in camera coordinates
+    vector<d_t> depth;       ///< Camera depth of each splat
+    vector<int> order;       ///< Splat indices sorted front to back
+    vector<int> leaves;      ///< Tree leaves sorted front to back
+    size_t drawn = 0;        ///< Splats of the last render that were blended
+    size_t blended = 0;      ///< Pixel updates of the last render
+};
+
+/**
+ * Sorts the splats front to back by their camera depth.
+ *
+ * Ties keep the index order, like a stable sort, but without the temporary
+ * buffer std::stable_sort allocates.
+ *
+ * @param scratch Holds the positions in trans_xyz; depth and order are
+ *        filled in.
+ */
+void sort_by_depth(RenderScratch &scratch) {
+    auto &depth = scratch.depth;
+    auto &order = scratch.order;
+    depth.resize(scratch.trans_xyz.size());
+    order.resize(scratch.trans_xyz.size());
+    for (size_t i = 0; i < depth.size(); i++)
+        depth[i] = scratch.trans_xyz[i][2];
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&depth](int i1, int i2) {
+        return depth[i1] < depth[i2] || (depth[i1] == depth[i2] && i1 < i2);
+    });
+}
+
+/**
+ * Orders the splats front to back by walking the leaves of a spatial tree
+ * and sorting only the splats within each leaf by their camera depth.
+ *
+ * Splats of different leaves are not compared, so the order is exact only
+ * up to the leaf boundaries: the leaves are in visibility order along every
+ * ray, not sorted by depth.
+ *
+ * @param tree The tree built over the positions of the rendered splats.
+ * @param cam The camera.
+ * @param scratch Holds the positions in trans_xyz; depth, leaves and order
+ *        are filled in.
+ */
+void sort_by_tree(const QuadTree &tree, const Camera &cam,
+                  RenderScratch &scratch) {
+    auto &depth = scratch.depth;
+    auto &order = scratch.order;
+    depth.resize(scratch.trans_xyz.size());
+    for (size_t i = 0; i < depth.size(); i++)
+        depth[i] = scratch.trans_xyz[i][2];
+    tree.order(cam.center(), scratch.leaves);
+    order.clear();
+    for (int l : scratch.leaves) {
+        auto leaf = tree.leaf(l);
+        size_t first = order.size();
+        order.insert(order.end(), leaf.begin(), leaf.end());
+        std::sort(order.begin() + first, order.end(), [&depth](int i1, int i2) {
+            return depth[i1] < depth[i2] ||
+                   (depth[i1] == depth[i2] && i1 < i2);
+        });
+    }
+}
+
 /**
  * @brief Represents an image with pixel values and an alpha mask.
  */
 struct Image {
-    int w, h;                      /**< Width and height of the image. */
+    int w = 0, h = 0;              /**< Width and height of the image. */
     std::vector<v3_t> image;       /**< Pixel values of the image. */
     std::vector<float> alpha_mask; /**< Alpha mask of the image. */
 
+    /**
+     * @brief Constructs an empty image, to be sized with reset.
+     */
+    Image() = default;
+
     /**
      * @brief Constructs an Image object with the given camera.
      *
      * @param cam The camera object used to determine the image size.
      */
-    Image(Camera const &cam) : w(cam.image_size_x), h(cam.image_size_y) {
-        image = std::vector<v3_t>(h * w, {0, 0, 0});
-        alpha_mask = std::vector<float>(h * w, 1);
+    Image(Camera const &cam) { reset(cam); }
+
+    /**
+     * @brief Resizes the image to the camera and clears it to transparent
+     * black, reusing the existing storage when it is large enough.
+     *
+     * @param cam The camera object used to determine the image size.
+     */
+    void reset(Camera const &cam) {
+        w = cam.image_size_x, h = cam.image_size_y;
+        image.assign(h * w, {0, 0, 0});
+        alpha_mask.assign(h * w, 1);
     }
 
     /**
@@ -275,21 +536,187 @@ struct Image {
     }
 
     /**
-     * Stores the image with the given file name.
+     * @brief Packs the pixel values and alpha mask into one RGBA value per
+     * pixel, with the alpha mask stored in the last channel.
+     *
+     * @param rgba The buffer to fill, resized to hold the whole image.
+     */
+    void to_rgba(vector<v4_t> &rgba) const {
+        rgba.resize(image.size());
+        to_rgba(std::span<v4_t>(rgba));
+    }
+
+    /**
+     * @brief Packs the image into preallocated RGBA storage.
+     *
+     * @param rgba The buffer to fill, at least as large as the image.
+     */
+    void to_rgba(std::span<v4_t> rgba) const {
+        for (size_t idx = 0; idx < image.size(); idx++)
+            rgba[idx] = v4_t{image[idx][0], image[idx][1], image[idx][2],
+                             alpha_mask[idx]};
+    }
+
+    /**
+     * @brief Unpacks RGBA values produced by to_rgba into the image.
+     *
+     * @param rgba The packed pixels, at least as many as the image holds.
+     */
+    void from_rgba(std::span<const v4_t> rgba) {
+        for (size_t idx = 0; idx < image.size(); idx++) {
+            image[idx] = v3_t{rgba[idx][0], rgba[idx][1], rgba[idx][2]};
+            alpha_mask[idx] = rgba[idx][3];
+        }
+    }
+
+    /**
+     * @brief Copies all rows of a smaller image of the same width into this
+     * image, starting at row y0.
+     *
+     * @param tile The image to copy.
+     * @param y0 The row of this image receiving the first row of the tile.
+     */
+    void paste(const Image &tile, int y0) {
+        std::copy(tile.image.begin(), tile.image.end(),
+                  image.begin() + y0 * w);
+        std::copy(tile.alpha_mask.begin(), tile.alpha_mask.end(),
+                  alpha_mask.begin() + y0 * w);
+    }
+
+    /**
+     * Stores the image with the given file name, as binary PPM if the name
+     * ends in ".ppm" and as BMP otherwise.
      *
      * @param file_name The name of the file to store the image.
      */
     void store_image(const std::string &file_name) const {
+        ImageFormat fmt(file_name, w, h);
+        std::string buf = fmt.header();
+        size_t data_start = buf.size();
+        buf.resize(fmt.file_size());
+        for (int y = 0; y < h; y++)
+            for (int x = 0; x < w; x++)
+                fmt.encode(image[y * w + x],
+                           &buf[data_start + y * fmt.row_stride() + 3 * x]);
         std::ofstream file;
         file.open(file_name, std::ios::binary);
-        for (auto p : image)
-            for (int c = 0; c < 3; c++)
-                file << (unsigned char)max(0,
-                                           min((int)floor(p[c] * 256.f), 0xff));
+        file.write(buf.data(), buf.size());
         file.close();
     }
 };
 
+/**
+ * @brief Per-tile bound of the transmittance of everything rendered in
+ * front of this rank, used to skip splats and pixels that cannot be seen.
+ *
+ * Every tile holds an upper bound of the transmittance of each of its
+ * pixels, so a tile only counts as occluded when all its pixels are below
+ * the threshold, and skipping it changes a pixel by less than the
+ * threshold.
+ */
+struct OcclusionMask {
+    int tile = 1;             ///< Size of a tile in pixels
+    int w = 0, h = 0;         ///< Size of the mask in tiles
+    float threshold = 1e-4f;  ///< Transmittance below which tiles are hidden
+    std::vector<float> transmittance;
+
+    /**
+     * @brief Constructs an empty mask, to be sized with reset.
+     */
+    OcclusionMask() = default;
+
+    /**
+     * @brief Constructs a fully transparent mask covering the camera image.
+     *
+     * @param cam The full-resolution camera.
+     * @param tile The size of a tile in pixels.
+     * @param threshold The transmittance below which a tile is occluded.
+     */
+    OcclusionMask(const Camera &cam, int tile, float threshold = 1e-4f) {
+        reset(cam, tile, threshold);
+    }
+
+    /**
+     * @brief Resizes the mask to the camera and makes it fully transparent,
+     * reusing the existing storage when it is large enough.
+     */
+    void reset(const Camera &cam, int tile_, float threshold_ = 1e-4f) {
+        tile = tile_;
+        w = (cam.image_size_x + tile - 1) / tile;
+        h = (cam.image_size_y + tile - 1) / tile;
+        threshold = threshold_;
+        transmittance.assign(w * h, 1);
+    }
+
+    /**
+     * @brief Bounds the transmittance of the tiles through some splats.
+     *
+     * A splat only lowers the bound of the tiles that lie entirely inside
+     * its pixel rectangle, by its smallest alpha over the tile. The alpha
+     * falls with a convex quadratic form of the pixel position, so that
+     * smallest alpha is at one of the corner pixels of the tile. The
+     * product over the splats is then at least the transmittance that
+     * render gives any pixel of the tile, in any order.
+     *
+     * @param cam The full-resolution camera.
+     * @param data The splats.
+     * @param out Filled with the bound of every tile.
+     */
+    void bound(const Camera &cam, const GaussianData &data,
+               std::vector<float> &out) const {
+        out.assign(w * h, 1);
+        int img_w = cam.image_size_x, img_h = cam.image_size_y;
+        for (size_t di = 0; di < data.size(); di++) {
+            auto d = PlotData(cam, cam.r_mat4.mat_mul(data.position(di)),
+                              data.covariance(di));
+            if (d.behind) continue;
+            int start_x = max(0, (int)round(d.x_c - d.x_r));
+            int start_y = max(0, (int)round(d.y_c - d.y_r));
+            int end_x = min(img_w, (int)round(d.x_c + d.x_r) + 1);
+            int end_y = min(img_h, (int)round(d.y_c + d.y_r) + 1);
+            auto alpha = [&](int x, int y) {
+                float c_x = x - d.x_c, c_y = y - d.y_c;
+                float power = -(d.A * c_x * c_x + d.C * c_y * c_y) / 2.0f -
+                              d.B * c_x * c_y;
+                return min(0.99f, data.opacity[di] * exp(power));
+            };
+            for (int ty = (start_y + tile - 1) / tile; ty < h; ty++) {
+                int y0 = ty * tile, y1 = min(img_h, y0 + tile);
+                if (y1 > end_y) break;
+                for (int tx = (start_x + tile - 1) / tile; tx < w; tx++) {
+                    int x0 = tx * tile, x1 = min(img_w, x0 + tile);
+                    if (x1 > end_x) break;
+                    float a = min(
+                        min(alpha(x0, y0), alpha(x1 - 1, y0)),
+                        min(alpha(x0, y1 - 1), alpha(x1 - 1, y1 - 1)));
+                    out[ty * w + tx] *= 1 - a;
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief Checks whether the tile containing a pixel is occluded.
+     */
+    bool occluded(int x, int y) const {
+        return transmittance[(y / tile) * w + x / tile] < threshold;
+    }
+
+    /**
+     * @brief Checks whether every tile overlapping a pixel rectangle is
+     * occluded.
+     *
+     * @param start_x, start_y The first pixel of the rectangle.
+     * @param end_x, end_y One past the last pixel of the rectangle.
+     */
+    bool occluded(int start_x, int start_y, int end_x, int end_y) const {
+        for (int ty = start_y / tile; ty * tile < end_y; ty++)
+            for (int tx = start_x / tile; tx * tile < end_x; tx++)
+                if (transmittance[ty * w + tx] >= threshold) return false;
+        return true;
+    }
+};
+
 /**
  * Draws a Gaussian splat on the given image using the specified camera,
  * direction, position, covariance, and color.
@@ -301,20 +728,28 @@ struct Image {
  * @param cov3d The covariance matrix of the Gaussian splat.
  * @param color_h The color harmonic used to determine the color of the Gaussian
  * splat.
+ * @param mask Optional occlusion mask; pixels in occluded tiles are skipped.
+ * @return The number of pixels blended.
  */
-void draw_gaussian(Image &image, const Camera &cam, const v4_t &dir, v4_t xyz,
-                   m3_t cov3d, ColorHarmonic color_h) {
+size_t draw_gaussian(Image &image, const Camera &cam, const v4_t &dir,
+                     v4_t xyz, const s3_t &cov3d, ColorHarmonic color_h,
+                     const OcclusionMask *mask = nullptr) {
     auto d = PlotData(cam, xyz, cov3d);
 
-    if (d.behind) return;
-    auto color = color_h.get_color(dir);
+    if (d.behind) return 0;
 
     int start_x = max(0, (int)round(d.x_c - d.x_r));
     int start_y = max(0, (int)round(d.y_c - d.y_r));
     int end_x = min(cam.image_size_x, (int)round(d.x_c + d.x_r) + 1);
     int end_y = min(cam.image_size_y, (int)round(d.y_c + d.y_r) + 1);
+    if (start_x >= end_x || start_y >= end_y) return 0;
+    if (mask && mask->occluded(start_x, start_y, end_x, end_y)) return 0;
+    auto color = color_h.get_color(dir);
+    size_t blended = 0;
     for (int y = start_y; y < end_y; y++) {
         for (int x = start_x; x < end_x; x++) {
+            if (mask && mask->occluded(x, y)) continue;
+            blended++;
             auto idx = y * cam.image_size_x + x;
             float c_x = x - d.x_c, c_y = y - d.y_c;
             float power =
@@ -325,31 +760,281 @@ void draw_gaussian(Image &image, const Camera &cam, const v4_t &dir, v4_t xyz,
             image.alpha_mask[idx] *= (1 - alpha);
         }
     }
+    return blended;
 }
 
 /**
- * Renders the scene using the given camera and Gaussian data.
+ * Renders the scene into an existing image, using scratch buffers kept by
+ * the caller so that repeated frames do not allocate.
  *
+ * @param image The image to render into, reset to the camera size.
  * @param cam The camera object used for rendering.
  * @param data The Gaussian data containing the scene information.
- * @return The rendered image.
+ * @param scratch The scratch buffers.
+ * @param mask Optional occlusion mask of the ranks in front of this one.
+ * @param tree Optional spatial tree over the splats; when given the splats
+ *        are ordered by walking it instead of sorting them all.
  */
-auto render(const Camera &cam, const GaussianData &data) {
-    Image image(cam);
+void render(Image &image, const Camera &cam, const GaussianData &data,
+            RenderScratch &scratch, const OcclusionMask *mask = nullptr,
+            const QuadTree *tree = nullptr) {
+    image.reset(cam);
 
     // Transform location
-    vector<v4_t> trans_xyz(data.xyz.size());
-    for (size_t di = 0; di < data.xyz.size(); di++)
-        trans_xyz[di] = cam.r_mat4.mat_mul(data.xyz[di]);
+    auto &trans_xyz = scratch.trans_xyz;
+    trans_xyz.resize(data.size());
+    for (size_t di = 0; di < data.size(); di++)
+        trans_xyz[di] = cam.r_mat4.mat_mul(data.position(di));
 
     // Sort on depth
-    const auto c_dir = v4_t{0, 0, 1, 0};
-    vector<int> sort_ind = sort_positions_in_direction(trans_xyz, c_dir);
+    if (tree)
+        sort_by_tree(*tree, cam, scratch);
+    else
+        sort_by_depth(scratch);
 
     v4_t camera_trans = cam.global_position();
-    for (auto di : sort_ind) {
-        draw_gaussian(image, cam, (data.xyz[di] - camera_trans).normalized(),
-                      trans_xyz[di], data.cov3d[di], data.colors[di]);
+    scratch.drawn = scratch.blended = 0;
+    for (auto di : scratch.order) {
+        size_t blended = draw_gaussian(
+            image, cam, (data.position(di) - camera_trans).normalized(),
+            trans_xyz[di], data.covariance(di), data.color(di), mask);
+        scratch.drawn += blended > 0;
+        scratch.blended += blended;
     }
+}
+
+/**
+ * Renders the scene using the given camera and Gaussian data.
+ *
+ * @param cam The camera object used for rendering.
+ * @param data The Gaussian data containing the scene information.
+ * @param mask Optional occlusion mask of the ranks in front of this one.
+ * @return The rendered image.
+ */
+auto render(const Camera &cam, const GaussianData &data,
+            const OcclusionMask *mask = nullptr) {
+    Image image;
+    RenderScratch scratch;
+    render(image, cam, data, scratch, mask);
     return image;
-}
\ No newline at end of file
+}
+
+/**
+ * @brief A splat projected to the screen, with the colour already evaluated
+ * and the pixel bounding box clipped to the image.
+ */
+struct ProjectedSplat {
+    float A, B, C, x_c, y_c, opacity;
+    v3_t color;
+    int start_x, start_y, end_x, end_y;
+};
+
+/**
+ * Projects all splats once so that the image can be rasterized in several
+ * independent pieces.
+ *
+ * @param cam The camera object used for rendering.
+ * @param data The Gaussian data containing the scene information.
+ * @param splats Filled with the visible splats, sorted front to back.
+ * @param scratch The buffers of the depth sort.
+ */
+void project(const Camera &cam, const GaussianData &data,
+             vector<ProjectedSplat> &splats, RenderScratch &scratch) {
+    auto &trans_xyz = scratch.trans_xyz;
+    trans_xyz.resize(data.size());
+    for (size_t di = 0; di < data.size(); di++)
+        trans_xyz[di] = cam.r_mat4.mat_mul(data.position(di));
+
+    sort_by_depth(scratch);
+
+    v4_t camera_trans = cam.global_position();
+    splats.clear();
+    for (auto di : scratch.order) {
+        auto d = PlotData(cam, trans_xyz[di], data.covariance(di));
+        if (d.behind) continue;
+        ProjectedSplat p;
+        p.start_x = max(0, (int)round(d.x_c - d.x_r));
+        p.start_y = max(0, (int)round(d.y_c - d.y_r));
+        p.end_x = min(cam.image_size_x, (int)round(d.x_c + d.x_r) + 1);
+        p.end_y = min(cam.image_size_y, (int)round(d.y_c + d.y_r) + 1);
+        if (p.start_x >= p.end_x || p.start_y >= p.end_y) continue;
+        ColorHarmonic color_h = data.color(di);
+        p.color =
+            color_h.get_color((data.position(di) - camera_trans).normalized());
+        p.opacity = color_h.opacity;
+        p.A = d.A, p.B = d.B, p.C = d.C, p.x_c = d.x_c, p.y_c = d.y_c;
+        splats.push_back(p);
+    }
+}
+
+/**
+ * Rasterizes the rows [start_y, end_y) of projected splats into an image
+ * that holds the rows starting at y0.
+ *
+ * @param image The image to draw into, as wide as the camera image.
+ * @param y0 The camera image row stored in the first row of the image.
+ * @param splats The projected splats, sorted front to back.
+ * @param start_y, end_y The camera image rows to draw.
+ * @param drawn Incremented by the number of splats blended into the rows.
+ * @param blended Incremented by the number of pixel updates.
+ */
+void rasterize(Image &image, int y0, std::span<const ProjectedSplat> splats,
+               int start_y, int end_y, size_t &drawn, size_t &blended) {
+    for (auto &p : splats) {
+        int sy = max(start_y, p.start_y), ey = min(end_y, p.end_y);
+        if (sy >= ey) continue;
+        drawn++;
+        blended += (size_t)(ey - sy) * (p.end_x - p.start_x);
+        for (int y = sy; y < ey; y++) {
+            for (int x = p.start_x; x < p.end_x; x++) {
+                auto idx = (y - y0) * image.w + x;
+                float c_x = x - p.x_c, c_y = y - p.y_c;
+                float power = -(p.A * c_x * c_x + p.C * c_y * c_y) / 2.0f -
+                              p.B * c_x * c_y;
+                float alpha = min(0.99f, p.opacity * exp(power));
+                image.image[idx] =
+                    image.image[idx] + image.alpha_mask[idx] * alpha * p.color;
+                image.alpha_mask[idx] *= (1 - alpha);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Scratch buffers of render_views, kept between frames so that their
+ * storage is reused.
+ */
+struct MultiViewScratch {
+    vector<int> group;  ///< Per view, the first view with the same centre
+    vector<v4_t> centers;  ///< Per view, the camera centre
+    vector<bool> radial;   ///< Per group, sorted by distance from the centre
+    vector<vector<d_t>> key;    ///< Per group, sort key of each entry
+    vector<vector<int>> order;  ///< Per group, entries sorted front to back
+    vector<vector<ProjectedSplat>> splats;  ///< Per view, one per entry
+    vector<ProjectedSplat> sorted;  ///< Visible splats of one view, in order
+    size_t drawn = 0;    ///< Splats blended in the last call, over all views
+    size_t blended = 0;  ///< Pixel updates of the last call, over all views
+};
+
+/**
+ * Renders several views of the same splats in a single sweep over the
+ * splat attributes, instead of one sweep per view.
+ *
+ * Every splat is read once and projected for all views; its colour is
+ * evaluated once per camera centre. Views that share a centre also share
+ * one depth order, sorted once: by camera depth if they also share the
+ * viewing axis, otherwise by the distance from the centre, which is a
+ * front-to-back order for every direction (as for the faces of a cube map).
+ * A single view renders the same image as render().
+ *
+ * @param images The images, one per camera, reset to the camera sizes.
+ * @param cams The cameras.
+ * @param data The Gaussian data containing the scene information.
+ * @param scratch The scratch buffers.
+ */
+void render_views(std::span<Image> images, std::span<const Camera> cams,
+                  const GaussianData &data, MultiViewScratch &scratch) {
+    size_t n_views = cams.size();
+    auto &group = scratch.group;
+    group.resize(n_views);
+    auto &centers = scratch.centers;
+    auto &radial = scratch.radial;
+    centers.resize(n_views);
+    radial.assign(n_views, false);
+    for (size_t v = 0; v < n_views; v++) {
+        images[v].reset(cams[v]);
+        centers[v] = cams[v].center();
+        group[v] = v;
+        for (size_t u = 0; u < v; u++) {
+            v4_t d = centers[v] - centers[u];
+            if (group[u] == (int)u && d.dot(d) <= 1e-12f) {
+                group[v] = u;
+                break;
+            }
+        }
+        auto &axis = cams[v].r_mat4[2], &first = cams[group[v]].r_mat4[2];
+        if (axis[0] != first[0] || axis[1] != first[1] || axis[2] != first[2])
+            radial[group[v]] = true;
+    }
+    scratch.key.resize(n_views);
+    scratch.order.resize(n_views);
+    scratch.splats.resize(n_views);
+    for (size_t v = 0; v < n_views; v++) {
+        scratch.key[v].clear();
+        scratch.splats[v].clear();
+    }
+
+    // The single sweep: every splat that any view of a group sees becomes
+    // an entry of the group, with a projected splat in each of its views.
+    ProjectedSplat culled{};
+    for (size_t di = 0; di < data.size(); di++) {
+        v4_t pos = data.position(di);
+        s3_t cov3d = data.covariance(di);
+        for (size_t g = 0; g < n_views; g++) {
+            if (group[g] != (int)g) continue;
+            bool visible = false, shaded = false;
+            v3_t color;
+            for (size_t v = g; v < n_views; v++) {
+                if (group[v] != (int)g) continue;
+                auto &cam = cams[v];
+                auto d = PlotData(cam, cam.r_mat4.mat_mul(pos), cov3d);
+                ProjectedSplat p;
+                p.start_x = max(0, (int)round(d.x_c - d.x_r));
+                p.start_y = max(0, (int)round(d.y_c - d.y_r));
+                p.end_x = min(cam.image_size_x, (int)round(d.x_c + d.x_r) + 1);
+                p.end_y = min(cam.image_size_y, (int)round(d.y_c + d.y_r) + 1);
+                if (d.behind || p.start_x >= p.end_x || p.start_y >= p.end_y)
+                    continue;
+                if (!visible) {
+                    // Views of this group before v did not see the splat.
+                    for (size_t u = g; u < v; u++)
+                        if (group[u] == (int)g)
+                            scratch.splats[u].push_back(culled);
+                    visible = true;
+                }
+                if (!shaded) {
+                    color = data.color(di).get_color(
+                        (pos - cam.global_position()).normalized());
+                    shaded = true;
+                }
+                p.color = color;
+                p.opacity = data.opacity[di];
+                p.A = d.A, p.B = d.B, p.C = d.C, p.x_c = d.x_c, p.y_c = d.y_c;
+                scratch.splats[v].push_back(p);
+            }
+            if (!visible) continue;
+            for (size_t v = g; v < n_views; v++)
+                if (group[v] == (int)g &&
+                    scratch.splats[v].size() < scratch.key[g].size() + 1)
+                    scratch.splats[v].push_back(culled);
+            v4_t rel = pos - centers[g];
+            scratch.key[g].push_back(radial[g]
+                                         ? rel.dot(rel)
+                                         : cams[g].r_mat4.mat_mul(pos)[2]);
+        }
+    }
+
+    for (size_t g = 0; g < n_views; g++) {
+        if (group[g] != (int)g) continue;
+        auto &key = scratch.key[g];
+        auto &order = scratch.order[g];
+        order.resize(key.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [&key](int i1, int i2) {
+            return key[i1] < key[i2] || (key[i1] == key[i2] && i1 < i2);
+        });
+    }
+    scratch.drawn = scratch.blended = 0;
+    for (size_t v = 0; v < n_views; v++) {
+        auto &sorted = scratch.sorted;
+        sorted.clear();
+        for (int e : scratch.order[group[v]]) {
+            auto &p = scratch.splats[v][e];
+            if (p.start_x < p.end_x) sorted.push_back(p);
+        }
+        rasterize(images[v], 0, sorted, 0, cams[v].image_size_y,
+                  scratch.drawn, scratch.blended);
+    }
+}
+
+#endif
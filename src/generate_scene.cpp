@@ -0,0 +1,312 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "splat_random.hpp"
+
+/*
+ * Writes a synthetic 3D Gaussian splatting scene as a binary PLY file with
+ * the same properties as a trained scene, so that it can be rendered by
+ * main_mpi.cpp in place of data/point_cloud.ply.
+ *
+ * Every splat is generated from the seed and its own index only, so the
+ * same options always give the same file, and a scene with more splats
+ * starts with the splats of a smaller one.
+ */
+
+/**
+ * @brief How the splat positions are spread over the scene.
+ */
+enum class Distribution {
+    Uniform,    ///< Uniform in the scene box
+    Clustered,  ///< Normally distributed around random cluster centres
+    Surface     ///< On a wavy height field, flattened along its normal
+};
+
+/**
+ * @brief Options of the generator.
+ */
+struct SceneOptions {
+    std::string output = "data/synthetic.ply";  ///< PLY file to write
+    uint64_t count = 1000000;  ///< Number of splats
+    uint64_t seed = 1;
+    Distribution distribution = Distribution::Uniform;
+    int clusters = 64;     ///< Number of clusters of the clustered scene
+    double extent = 1;     ///< Half the side of the scene box
+    /// Centre of the scene box, by default the point the default camera of
+    /// main_mpi.cpp looks at.
+    double center[3] = {0.0706437, 1.88046, 1.16585};
+    double scale_mean = -4, scale_sd = 0.5;     ///< Of the log scales
+    double opacity_mean = 0, opacity_sd = 2;    ///< Of the opacity logits
+    int sh_degree = 3;     ///< Spherical harmonics degree, 0 to 3
+};
+
+/**
+ * Parses a count with an optional k, M or G suffix.
+ *
+ * @param text The count, for example "500M".
+ * @param count Set to the parsed count.
+ * @return true if the text was a positive count.
+ */
+bool parse_count(const std::string &text, uint64_t &count) {
+    size_t end = 0;
+    double v;
+    try {
+        v = std::stod(text, &end);
+    } catch (const std::exception &) {
+        return false;
+    }
+    std::string suffix = text.substr(end);
+    if (suffix == "k")
+        v *= 1e3;
+    else if (suffix == "M")
+        v *= 1e6;
+    else if (suffix == "G")
+        v *= 1e9;
+    else if (!suffix.empty())
+        return false;
+    if (v < 1) return false;
+    count = (uint64_t)v;
+    return true;
+}
+
+/**
+ * Parses two comma separated numbers.
+ *
+ * @param text The numbers, for example "-4,0.5".
+ * @param a, b Set to the numbers.
+ * @return true if the text held exactly two numbers.
+ */
+bool parse_pair(const std::string &text, double &a, double &b) {
+    auto comma = text.find(',');
+    if (comma == std::string::npos) return false;
+    try {
+        size_t end_a, end_b;
+        a = std::stod(text.substr(0, comma), &end_a);
+        b = std::stod(text.substr(comma + 1), &end_b);
+        return end_a == comma && end_b == text.size() - comma - 1;
+    } catch (const std::exception &) {
+        return false;
+    }
+}
+
+/**
+ * Parses three comma separated numbers.
+ *
+ * @param text The numbers, for example "0,1.5,1".
+ * @param v Set to the numbers.
+ * @return true if the text held exactly three numbers.
+ */
+bool parse_triple(const std::string &text, double (&v)[3]) {
+    auto comma = text.find(',');
+    if (comma == std::string::npos) return false;
+    try {
+        size_t end;
+        v[0] = std::stod(text.substr(0, comma), &end);
+        if (end != comma) return false;
+    } catch (const std::exception &) {
+        return false;
+    }
+    return parse_pair(text.substr(comma + 1), v[1], v[2]);
+}
+
+/**
+ * @brief Parses the command line.
+ *
+ * Accepted flags are `--output <path>`, `--count <n[k|M|G]>`,
+ * `--seed <n>`, `--distribution <uniform|clustered|surface>`,
+ * `--clusters <n>`, `--extent <half side>`, `--center <x>,<y>,<z>`,
+ * `--scale <mean>,<sd>`, `--opacity <mean>,<sd>` and `--sh-degree <0-3>`.
+ *
+ * @param argc The argument count.
+ * @param argv The argument values.
+ * @param opt The options to fill in.
+ * @return true if all arguments were recognised.
+ */
+bool parse_options(int argc, char **argv, SceneOptions &opt) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) return false;
+        std::string value = argv[++i];
+        if (arg == "--output") {
+            opt.output = value;
+        } else if (arg == "--count") {
+            if (!parse_count(value, opt.count)) return false;
+        } else if (arg == "--seed") {
+            opt.seed = std::stoull(value);
+        } else if (arg == "--distribution") {
+            if (value == "uniform")
+                opt.distribution = Distribution::Uniform;
+            else if (value == "clustered")
+                opt.distribution = Distribution::Clustered;
+            else if (value == "surface")
+                opt.distribution = Distribution::Surface;
+            else
+                return false;
+        } else if (arg == "--clusters") {
+            opt.clusters = std::stoi(value);
+            if (opt.clusters < 1) return false;
+        } else if (arg == "--extent") {
+            opt.extent = std::stod(value);
+            if (opt.extent <= 0) return false;
+        } else if (arg == "--center") {
+            if (!parse_triple(value, opt.center)) return false;
+        } else if (arg == "--scale") {
+            if (!parse_pair(value, opt.scale_mean, opt.scale_sd)) return false;
+        } else if (arg == "--opacity") {
+            if (!parse_pair(value, opt.opacity_mean, opt.opacity_sd))
+                return false;
+        } else if (arg == "--sh-degree") {
+            opt.sh_degree = std::stoi(value);
+            if (opt.sh_degree < 0 || opt.sh_degree > 3) return false;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Number of higher order SH coefficients per colour channel.
+ */
+int rest_coefficients(int sh_degree) {
+    return (sh_degree + 1) * (sh_degree + 1) - 1;
+}
+
+/**
+ * Writes the PLY header, with the properties in the order of trained
+ * scenes.
+ *
+ * @param out The file.
+ * @param opt The options of the scene.
+ * @return The number of float properties per splat.
+ */
+int write_header(std::ostream &out, const SceneOptions &opt) {
+    std::vector<std::string> names = {"x",      "y",      "z",
+                                      "nx",     "ny",     "nz",
+                                      "f_dc_0", "f_dc_1", "f_dc_2"};
+    for (int i = 0; i < 3 * rest_coefficients(opt.sh_degree); i++)
+        names.push_back("f_rest_" + std::to_string(i));
+    for (auto n : {"opacity", "scale_0", "scale_1", "scale_2", "rot_0",
+                   "rot_1", "rot_2", "rot_3"})
+        names.push_back(n);
+
+    out << "ply\nformat binary_little_endian 1.0\n"
+        << "comment synthetic scene, seed " << opt.seed << "\n"
+        << "element vertex " << opt.count << "\n";
+    for (auto &n : names) out << "property float " << n << "\n";
+    out << "end_header\n";
+    return names.size();
+}
+
+/**
+ * @brief Height of the surface scene at (x, z).
+ */
+double surface_height(double x, double z, double extent) {
+    double k = 2 * M_PI / extent;
+    return 0.25 * extent * std::sin(k * x) * std::cos(k * z);
+}
+
+/**
+ * Generates one splat.
+ *
+ * @param opt The options of the scene.
+ * @param centres The cluster centres, three coordinates each.
+ * @param index The index of the splat.
+ * @param out Filled with the properties, in the order of write_header.
+ */
+void generate_splat(const SceneOptions &opt, const std::vector<double> &centres,
+                    uint64_t index, float *out) {
+    SplatRandom rng(opt.seed, index);
+    double e = opt.extent;
+    double pos[3], scale[3], rot[4] = {1, 0, 0, 0};
+    for (auto &s : scale) s = rng.normal(opt.scale_mean, opt.scale_sd);
+
+    if (opt.distribution == Distribution::Uniform) {
+        for (auto &p : pos) p = rng.uniform(-e, e);
+    } else if (opt.distribution == Distribution::Clustered) {
+        int c = rng.next() % opt.clusters;
+        double sd = centres[3 * opt.clusters + c];
+        for (int a = 0; a < 3; a++)
+            pos[a] = rng.normal(centres[3 * c + a], sd);
+    } else {
+        pos[0] = rng.uniform(-e, e);
+        pos[2] = rng.uniform(-e, e);
+        pos[1] = surface_height(pos[0], pos[2], e) +
+                 rng.normal(0, 0.01 * e);
+        // The normal of the height field becomes the second row of the
+        // rotation matrix, the axis of scale_1, which is made thin.
+        double h = 1e-4 * e;
+        double n[3] = {-(surface_height(pos[0] + h, pos[2], e) -
+                         surface_height(pos[0] - h, pos[2], e)) / (2 * h),
+                       1,
+                       -(surface_height(pos[0], pos[2] + h, e) -
+                         surface_height(pos[0], pos[2] - h, e)) / (2 * h)};
+        double len = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        for (auto &v : n) v /= len;
+        // Rotation taking n to the y axis: w = 1 + n.y, xyz = n x y.
+        rot[0] = 1 + n[1], rot[1] = -n[2], rot[2] = 0, rot[3] = n[0];
+        scale[1] -= std::log(10.0);
+    }
+
+    int k = 0;
+    for (int a = 0; a < 3; a++) out[k++] = opt.center[a] + pos[a];
+    for (int i = 0; i < 3; i++) out[k++] = 0;
+    for (int i = 0; i < 3; i++) out[k++] = rng.normal(0, 1);
+    for (int i = 0; i < 3 * rest_coefficients(opt.sh_degree); i++)
+        out[k++] = rng.normal(0, 0.1);
+    out[k++] = rng.normal(opt.opacity_mean, opt.opacity_sd);
+    for (auto s : scale) out[k++] = s;
+    for (auto r : rot) out[k++] = r;
+}
+
+int main(int argc, char **argv) {
+    SceneOptions opt;
+    if (!parse_options(argc, argv, opt)) {
+        std::cerr << "Usage: " << argv[0] << " [--output <path>]"
+                  << " [--count <n[k|M|G]>] [--seed <n>]"
+                  << " [--distribution <uniform|clustered|surface>]"
+                  << " [--clusters <n>] [--extent <half side>]"
+                  << " [--center <x>,<y>,<z>]"
+                  << " [--scale <mean>,<sd>] [--opacity <mean>,<sd>]"
+                  << " [--sh-degree <0-3>]" << std::endl;
+        return 1;
+    }
+
+    // Cluster centres and sizes come from the indices past the splats' own,
+    // counted down from the top so they never collide with a splat.
+    std::vector<double> centres(4 * opt.clusters);
+    for (int c = 0; c < opt.clusters; c++) {
+        SplatRandom rng(opt.seed, ~(uint64_t)c);
+        for (int a = 0; a < 3; a++)
+            centres[3 * c + a] = rng.uniform(-opt.extent, opt.extent);
+        centres[3 * opt.clusters + c] = opt.extent * rng.uniform(0.02, 0.1);
+    }
+
+    std::ofstream out(opt.output, std::ios::binary);
+    if (!out) {
+        std::cerr << "Cannot open " << opt.output << std::endl;
+        return 1;
+    }
+    int n_props = write_header(out, opt);
+
+    // Written in chunks so that the memory use does not grow with count.
+    const uint64_t chunk = 1 << 16;
+    std::vector<float> buf(chunk * n_props);
+    for (uint64_t first = 0; first < opt.count; first += chunk) {
+        uint64_t n = std::min(chunk, opt.count - first);
+        for (uint64_t i = 0; i < n; i++)
+            generate_splat(opt, centres, first + i, &buf[i * n_props]);
+        out.write(reinterpret_cast<const char *>(buf.data()),
+                  n * n_props * sizeof(float));
+    }
+    if (!out) {
+        std::cerr << "Failed writing " << opt.output << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,94 @@
+#ifndef IMAGE_FORMAT_IMPORT
+#define IMAGE_FORMAT_IMPORT 1
+
+#include <cmath>
+#include <cstdint>
+#include <string>
+
+#include "default_types.hpp"
+
+/**
+ * @brief Layout of an uncompressed 24-bit image file, either binary PPM (P6)
+ * or BMP.
+ *
+ * BMP files are written top-down (negative height) so that both formats
+ * store row y at header_size() + y * row_stride(), which lets ranks compute
+ * the file offset of any pixel without talking to each other.
+ */
+struct ImageFormat {
+    enum Kind { PPM, BMP } kind;
+    int w, h;
+
+    /**
+     * @brief Picks the format from the file extension, ".ppm" for PPM and
+     * BMP otherwise.
+     */
+    ImageFormat(const std::string &file_name, int w, int h) : w(w), h(h) {
+        bool ppm = file_name.size() >= 4 &&
+                   file_name.compare(file_name.size() - 4, 4, ".ppm") == 0;
+        kind = ppm ? PPM : BMP;
+    }
+
+    /**
+     * @brief Bytes per row, including the 4-byte alignment padding of BMP.
+     */
+    size_t row_stride() const {
+        return kind == PPM ? 3 * w : (3 * w + 3) / 4 * 4;
+    }
+
+    /**
+     * @brief The file header.
+     */
+    std::string header() const {
+        if (kind == PPM)
+            return "P6\n" + std::to_string(w) + " " + std::to_string(h) +
+                   "\n255\n";
+        std::string hdr(54, '\0');
+        auto put = [&hdr](size_t at, uint32_t v, int bytes) {
+            for (int i = 0; i < bytes; i++) hdr[at + i] = (v >> (8 * i)) & 0xff;
+        };
+        uint32_t data_size = row_stride() * h;
+        hdr[0] = 'B', hdr[1] = 'M';
+        put(2, 54 + data_size, 4);  // file size
+        put(10, 54, 4);             // pixel data offset
+        put(14, 40, 4);             // BITMAPINFOHEADER size
+        put(18, w, 4);
+        put(22, (uint32_t)-h, 4);   // negative height: top-down rows
+        put(26, 1, 2);              // planes
+        put(28, 24, 2);             // bits per pixel
+        put(34, data_size, 4);
+        return hdr;
+    }
+
+    /**
+     * @brief Size of the header in bytes.
+     */
+    size_t header_size() const { return header().size(); }
+
+    /**
+     * @brief Total size of the file in bytes.
+     */
+    size_t file_size() const { return header_size() + row_stride() * h; }
+
+    /**
+     * @brief File offset of the pixel (x, y).
+     */
+    size_t offset(int x, int y) const {
+        return header_size() + y * row_stride() + 3 * x;
+    }
+
+    /**
+     * @brief Writes the three bytes of one pixel in file channel order.
+     *
+     * @param p The pixel colour, nominally in [0, 1].
+     * @param out Where to write the bytes.
+     */
+    void encode(const v3_t &p, char *out) const {
+        for (int c = 0; c < 3; c++) {
+            int ch = kind == PPM ? c : 2 - c;
+            out[c] = (char)max(0, min((int)floor(p[ch] * 256.f), 0xff));
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,130 @@
+#ifndef KD_DECOMPOSITION_IMPORT
+#define KD_DECOMPOSITION_IMPORT 1
+
+#include <algorithm>
+#include <array>
+#include <numeric>
+#include <span>
+#include <vector>
+
+#include "default_types.hpp"
+
+/**
+ * @brief View-independent split of the scene into one k-d region per rank.
+ *
+ * Every inner node cuts its splats at a plane across the longest side of
+ * their bounding box, dividing them in proportion to the number of ranks on
+ * each side, so the regions hold equal numbers of splats for any number of
+ * ranks. The tree only depends on the positions, so every rank builds the
+ * same tree without communicating, and the front-to-back order of the
+ * regions for any camera follows from the cut planes.
+ */
+struct RankTree {
+    struct Node {
+        int axis = 0;        ///< Axis of the cut, 0 to 2
+        d_t cut = 0;         ///< Position of the cut plane
+        int lo = -1, hi = -1;  ///< Children below and above the cut, -1 in leaves
+        int rank = 0;        ///< Owner of a leaf
+    };
+
+    vector<Node> nodes;  ///< Node 0 is the root
+    vector<int> idx;     ///< Splat indices, grouped by region
+    vector<int> start;   ///< Rank r owns idx[start[r], start[r + 1])
+
+    /**
+     * @brief Builds the tree.
+     *
+     * @param xyz The positions of all splats.
+     * @param size The number of ranks.
+     */
+    void build(const vector<v4_t> &xyz, int size) {
+        nodes.clear();
+        idx.resize(xyz.size());
+        std::iota(idx.begin(), idx.end(), 0);
+        start.assign(size + 1, 0);
+        build_node(xyz, 0, idx.size(), 0, size);
+        start[size] = idx.size();
+    }
+
+    /**
+     * @brief Splat indices of the region of a rank.
+     */
+    std::span<const int> region(int rank) const {
+        return std::span<const int>(idx).subspan(
+            start[rank], start[rank + 1] - start[rank]);
+    }
+
+    /**
+     * @brief Lists the ranks front to back as seen from a camera position.
+     *
+     * @param camera_pos The camera position in world coordinates.
+     * @param ranks Filled with the ranks, nearest region first.
+     */
+    void order(const v4_t &camera_pos, vector<int> &ranks) const {
+        ranks.clear();
+        // Every cut halves the ranks, so the tree is at most 32 deep and
+        // the stack holds at most one node per level plus one.
+        std::array<int, 64> stack;
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0) {
+            const Node &node = nodes[stack[--top]];
+            if (node.lo == -1) {
+                ranks.push_back(node.rank);
+                continue;
+            }
+            bool above = camera_pos[node.axis] >= node.cut;
+            stack[top++] = above ? node.lo : node.hi;
+            stack[top++] = above ? node.hi : node.lo;
+        }
+    }
+
+   private:
+    /**
+     * @brief Builds the subtree over idx[first, last) for the ranks
+     * [rank, rank + n_ranks).
+     *
+     * @return The index of the subtree's root.
+     */
+    int build_node(const vector<v4_t> &xyz, size_t first, size_t last,
+                   int rank, int n_ranks) {
+        int id = nodes.size();
+        nodes.emplace_back();
+        if (n_ranks == 1) {
+            nodes[id].rank = rank;
+            start[rank] = first;
+            return id;
+        }
+
+        v4_t mn{MAXFLOAT, MAXFLOAT, MAXFLOAT, 0};
+        v4_t mx{-MAXFLOAT, -MAXFLOAT, -MAXFLOAT, 0};
+        for (size_t i = first; i < last; i++)
+            for (int a = 0; a < 3; a++) {
+                mn[a] = min(mn[a], xyz[idx[i]][a]);
+                mx[a] = max(mx[a], xyz[idx[i]][a]);
+            }
+        int axis = 0;
+        for (int a = 1; a < 3; a++)
+            if (mx[a] - mn[a] > mx[axis] - mn[axis]) axis = a;
+
+        int lo_ranks = n_ranks / 2;
+        size_t mid = first + (last - first) * lo_ranks / n_ranks;
+        if (mid < last)
+            std::nth_element(idx.begin() + first, idx.begin() + mid,
+                             idx.begin() + last, [&](int a, int b) {
+                                 return xyz[a][axis] < xyz[b][axis];
+                             });
+        d_t cut = mid < last ? xyz[idx[mid]][axis] : mx[axis];
+
+        int lo = build_node(xyz, first, mid, rank, lo_ranks);
+        int hi = build_node(xyz, mid, last, rank + lo_ranks,
+                            n_ranks - lo_ranks);
+        nodes[id].axis = axis;
+        nodes[id].cut = cut;
+        nodes[id].lo = lo;
+        nodes[id].hi = hi;
+        return id;
+    }
+};
+
+#endif
@@ -0,0 +1,207 @@
+#ifndef LOAD_BALANCE_IMPORT
+#define LOAD_BALANCE_IMPORT 1
+
+#include <mpi.h>
+
+#include <string>
+#include <tuple>
+
+#include "generate_image.hpp"
+
+/**
+ * @brief How the depth slab boundaries are placed.
+ */
+enum class Balance {
+    Count,    ///< Equal number of splats per rank
+    Cost,     ///< Equal estimated render cost per rank
+    Feedback  ///< Estimated cost corrected by measured render times
+};
+
+/**
+ * @brief Parses a balance mode from its command line name.
+ *
+ * @param name One of "count", "cost" or "feedback".
+ * @param mode Set to the parsed mode on success.
+ * @return true if the name was recognised.
+ */
+bool parse_balance(const std::string &name, Balance &mode) {
+    if (name == "count")
+        mode = Balance::Count;
+    else if (name == "cost")
+        mode = Balance::Cost;
+    else if (name == "feedback")
+        mode = Balance::Feedback;
+    else
+        return false;
+    return true;
+}
+
+/**
+ * @brief A splat in the distributed depth sort: depth, element index and
+ * estimated cost.
+ */
+using SlabEntry = std::tuple<float, int, float>;
+
+/**
+ * Estimates the render cost of a splat as its on-screen footprint in pixels
+ * times its opacity, plus one for the per-splat projection and sort work.
+ *
+ * @param cam The camera.
+ * @param xyz The position of the splat in camera coordinates.
+ * @param cov3d The 3D covariance of the splat.
+ * @param opacity The opacity of the splat.
+ * @return The estimated cost in blended pixels.
+ */
+float splat_cost(const Camera &cam, const v4_t &xyz, const s3_t &cov3d,
+                 d_t opacity) {
+    auto d = PlotData(cam, xyz, cov3d);
+    if (d.behind) return 1;
+    int start_x = max(0, (int)round(d.x_c - d.x_r));
+    int start_y = max(0, (int)round(d.y_c - d.y_r));
+    int end_x = min(cam.image_size_x, (int)round(d.x_c + d.x_r) + 1);
+    int end_y = min(cam.image_size_y, (int)round(d.y_c + d.y_r) + 1);
+    float area = max(0, end_x - start_x) * max(0, end_y - start_y);
+    return 1 + area * opacity;
+}
+
+/**
+ * @brief Per-slab correction of the cost model from measured render times,
+ * carried from one frame to the next.
+ *
+ * After a frame every rank knows the depth range of its slab, the modelled
+ * cost of it and how long it took to render. The ratio of time to cost
+ * becomes the multiplier for splats falling in that depth range next frame.
+ */
+struct CostFeedback {
+    vector<float> bounds;  ///< Largest depth of each rank's last slab
+    vector<float> scale;   ///< Cost multiplier of each slab
+    vector<float> new_bounds, new_scale;  ///< Scratch of update
+    vector<double> ks;                    ///< Scratch of update
+
+    /**
+     * @brief Returns the cost multiplier for a splat at the given depth.
+     */
+    float scale_at(float depth) const {
+        if (bounds.empty()) return 1;
+        size_t r = std::lower_bound(bounds.begin(), bounds.end(), depth) -
+                   bounds.begin();
+        return scale[min(r, scale.size() - 1)];
+    }
+
+    /**
+     * @brief Updates the multipliers from the frame just rendered.
+     *
+     * @param slab The entries owned by this rank, sorted by depth, with the
+     *        cost already multiplied by scale_at.
+     * @param render_ms The time this rank spent rendering its slab.
+     * @param comm The communicator, ranked front to back.
+     */
+    void update(const vector<SlabEntry> &slab, double render_ms,
+                MPI_Comm comm) {
+        int size;
+        MPI_Comm_size(comm, &size);
+        float hi = slab.empty() ? -MAXFLOAT : std::get<0>(slab.back());
+        double cost = 0;
+        for (auto &[depth, i, c] : slab)
+            if (i != -1) cost += c / scale_at(depth);
+        double k = cost > 0 ? render_ms / cost : 0;
+
+        new_bounds.resize(size);
+        ks.resize(size);
+        MPI_Allgather(&hi, 1, MPI_FLOAT, new_bounds.data(), 1, MPI_FLOAT,
+                      comm);
+        MPI_Allgather(&k, 1, MPI_DOUBLE, ks.data(), 1, MPI_DOUBLE, comm);
+        for (int r = 1; r < size; r++)
+            new_bounds[r] = max(new_bounds[r], new_bounds[r - 1]);
+
+        double mean = 0;
+        int n = 0;
+        for (auto v : ks)
+            if (v > 0) mean += v, n++;
+        if (n == 0) return;
+        mean /= n;
+
+        // Damped so that the boundaries do not oscillate between frames.
+        new_scale.resize(size);
+        for (int r = 0; r < size; r++) {
+            float old = r == 0 ? scale_at(-MAXFLOAT)
+                               : scale_at((new_bounds[r - 1] + new_bounds[r]) / 2);
+            float measured = ks[r] > 0 ? ks[r] / mean : old;
+            new_scale[r] = (old + measured) / 2;
+        }
+        bounds.swap(new_bounds);
+        scale.swap(new_scale);
+    }
+};
+
+/**
+ * @brief Buffers of balance_by_cost, kept between frames so that their
+ * storage is reused.
+ */
+struct BalanceScratch {
+    vector<SlabEntry> recv;  ///< The rebalanced entries
+    vector<int> send_counts, recv_counts;  ///< Entries per rank
+    vector<int> sc, sd, rc, rd;  ///< Byte counts and offsets per rank
+};
+
+/**
+ * Moves the slab boundaries of globally sorted entries so that every rank
+ * owns the same total cost instead of the same number of entries.
+ *
+ * Entries keep their global order; each one goes to the rank whose share of
+ * the cumulative cost contains its midpoint.
+ *
+ * @param mydata The sorted entries of this rank, replaced by the rebalanced
+ *        slab.
+ * @param comm The communicator, ranked front to back.
+ * @param scratch The exchange buffers; its recv buffer is swapped with
+ *        mydata at the end so that its storage can be reused.
+ */
+void balance_by_cost(vector<SlabEntry> &mydata, MPI_Comm comm,
+                     BalanceScratch &scratch) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    double local = 0, before = 0, total;
+    for (auto &e : mydata) local += std::get<2>(e);
+    MPI_Exscan(&local, &before, 1, MPI_DOUBLE, MPI_SUM, comm);
+    if (rank == 0) before = 0;
+    MPI_Allreduce(&local, &total, 1, MPI_DOUBLE, MPI_SUM, comm);
+    if (total <= 0) return;
+    double share = total / size;
+
+    auto &send_counts = scratch.send_counts;
+    auto &recv_counts = scratch.recv_counts;
+    send_counts.assign(size, 0);
+    recv_counts.resize(size);
+    double cum = before;
+    for (auto &e : mydata) {
+        double c = std::get<2>(e);
+        int dest = min(size - 1, (int)((cum + c / 2) / share));
+        send_counts[dest]++;
+        cum += c;
+    }
+    MPI_Alltoall(send_counts.data(), 1, MPI_INT, recv_counts.data(), 1,
+                 MPI_INT, comm);
+
+    auto &sc = scratch.sc, &sd = scratch.sd, &rc = scratch.rc,
+         &rd = scratch.rd;
+    sc.resize(size), rc.resize(size);
+    sd.assign(size, 0), rd.assign(size, 0);
+    for (int r = 0; r < size; r++) {
+        sc[r] = send_counts[r] * sizeof(SlabEntry);
+        rc[r] = recv_counts[r] * sizeof(SlabEntry);
+        if (r > 0) {
+            sd[r] = sd[r - 1] + sc[r - 1];
+            rd[r] = rd[r - 1] + rc[r - 1];
+        }
+    }
+    auto &recv = scratch.recv;
+    recv.resize((rd[size - 1] + rc[size - 1]) / sizeof(SlabEntry));
+    MPI_Alltoallv(mydata.data(), sc.data(), sd.data(), MPI_BYTE, recv.data(),
+                  rc.data(), rd.data(), MPI_BYTE, comm);
+    mydata.swap(recv);
+}
+
+#endif
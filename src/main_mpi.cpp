@@ -1,8 +1,24 @@
+#include <sys/resource.h>
+
 #include <chrono>
+#include <fstream>
+#include <iomanip>
 
+#include "alloc_count.hpp"
+#include "benchmark.hpp"
+#include "camera_path.hpp"
+#include "composite.hpp"
 #include "generate_image.hpp"
+#include "load_balance.hpp"
 #include "mpi.h"
+#include "parallel_io.hpp"
+#include "profile.hpp"
+#include "render_context.hpp"
+#include "server.hpp"
+#include "sort_first.hpp"
+#include "trace.hpp"
 #include "transpose_sort.cpp"
+#include "work_steal.hpp"
 
 MPI_Comm comm = MPI_COMM_WORLD;
 int world_size;
@@ -13,9 +29,11 @@ int world_rank;
  *
  * @param image The Image object to be sent.
  * @param dest The destination rank to which the image will be sent.
+ * @param comm The communicator of dest.
  * @return 0 on success.
  */
-int send_image(Image const &image, int dest) {
+int send_image(Image const &image, int dest, MPI_Comm comm) {
+    TRACE_SCOPE("send_image");
     MPI_Send(image.image.data(), image.image.size() * sizeof(image.image[0]),
              MPI_BYTE, dest, 0, comm);
     MPI_Send(image.alpha_mask.data(),
@@ -29,67 +47,119 @@ int send_image(Image const &image, int dest) {
  *
  * @param image The Image object to store the received image data.
  * @param orig The rank of the process from which to receive the data.
+ * @param comm The communicator of orig.
  * @return 0 on success, or an error code on failure.
  */
-int recv_image(Image &image, int orig) {
+int recv_image(Image &image, int orig, MPI_Comm comm) {
+    TRACE_SCOPE("recv_image");
     MPI_Status s;
     MPI_Recv(image.image.data(), image.image.size() * sizeof(image.image[0]),
-             MPI_BYTE, orig, 0, MPI_COMM_WORLD, &s);
+             MPI_BYTE, orig, 0, comm, &s);
     MPI_Recv(image.alpha_mask.data(),
              image.alpha_mask.size() * sizeof(image.alpha_mask[0]), MPI_BYTE,
-             orig, 0, MPI_COMM_WORLD, &s);
+             orig, 0, comm, &s);
     return s.MPI_ERROR;
 }
 
 #define ts(var) auto var = std::chrono::high_resolution_clock::now()
 #define diff(t1, t2) duration_cast<std::chrono::milliseconds>(t2 - t1).count()
 
+/**
+ * Returns the memory high-water mark of this process.
+ *
+ * @return The peak resident set size in MB.
+ */
+long peak_memory_mb() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss / 1024;
+}
+
+/**
+ * Lists the element indices assigned round-robin to this rank.
+ *
+ * @param number_elements The total number of elements.
+ * @param el Filled with the indices world_rank, world_rank + world_size, ...
+ */
+void strided_elements(int number_elements, std::vector<int> &el) {
+    el.clear();
+    for (int i = world_rank; i < number_elements; i += world_size) {
+        el.push_back(i);
+    }
+}
+
 /**
  * Retrieves a vector of tuples containing the dot product of each element's
- * position with the given direction vector and the corresponding element index.
+ * position with the given direction vector, the corresponding element index
+ * and the estimated render cost of the element.
  *
  * @param ply_data The PLYData object containing the element data.
  * @param dir The direction vector used for calculating the dot product.
- * @return A vector of tuples, where each tuple contains the dot product and the
- *         corresponding element index.
+ * @param data Filled with tuples, where each tuple contains the dot product,
+ *        the corresponding element index and its cost.
+ * @param cam The camera used to estimate the cost, or nullptr to give every
+ *        element a cost of 1.
+ * @param feedback Optional correction of the cost from earlier frames.
+ * @param scene The decoded splats of ply_data to read instead of the file,
+ *        or nullptr.
  */
-vector<std::tuple<float, int>> get_elements(happly::PLYData &ply_data,
-                                            v4_t dir) {
+void get_elements(happly::PLYData &ply_data, v4_t dir,
+                  vector<SlabEntry> &data, const Camera *cam = nullptr,
+                  const CostFeedback *feedback = nullptr,
+                  const GaussianData *scene = nullptr) {
     int number_elements = GaussianData::get_size(ply_data);
+    PlyColumns file(ply_data);
 
-    std::vector<int> el;
+    data.clear();
     for (int i = world_rank; i < number_elements; i += world_size) {
-        el.push_back(i);
-    }
-
-    auto xyz = GaussianData::load_xyz(ply_data, el);
-    std::vector<std::tuple<float, int>> data;
-    for (size_t i = 0; i < xyz.size(); i++) {
-        data.push_back({xyz[i].dot(dir), el[i]});
+        v4_t xyz = scene ? scene->position(i) : file.position(i);
+        float cost = 1;
+        if (cam && scene)
+            cost = splat_cost(*cam, cam->r_mat4.mat_mul(xyz),
+                              scene->covariance(i), scene->opacity[i]);
+        else if (cam)
+            cost = splat_cost(*cam, cam->r_mat4.mat_mul(xyz),
+                              file.covariance(i), file.activated_opacity(i));
+        float depth = xyz.dot(dir);
+        if (feedback) cost *= feedback->scale_at(depth);
+        data.push_back({depth, i, cost});
     }
     if (number_elements % world_size &&
         world_rank >= (number_elements % world_size)) {
-        data.push_back({0, -1});
+        data.push_back({0, -1, 0});
     }
-    return data;
 }
 
 /**
- * Sorts the positions based on the depths.
+ * Sorts the positions based on the depths, in place.
  *
- * @param depths A vector of tuples containing the depths and indecies.
- * @return A vector of sorted indecies.
+ * @param sorter The sort engine, holding the depths, indecies and costs of
+ *        this rank in mydata, replaced by the sorted slab of this rank
+ *        including padding entries.
+ * @param by_cost Whether to move the slab boundaries so that every rank gets
+ *        the same total cost instead of the same number of elements.
+ * @param scratch Buffers of the cost balancing.
  */
-vector<int> sort_positions(std::vector<std::tuple<float, int>> depths) {
-    SortEngine<std::tuple<float, int>> sorter(depths, world_rank, world_size);
+void sort_positions(SortEngine<SlabEntry> &sorter, bool by_cost,
+                    BalanceScratch &scratch) {
+    sorter.prepare();
     sorter.run_sort();
-    std::vector<int> elements;
-    for (auto &d : sorter.mydata) {
+    if (by_cost) balance_by_cost(sorter.mydata, comm, scratch);
+}
+
+/**
+ * Extracts the element indices of a slab, skipping padding entries.
+ *
+ * @param slab The sorted slab of this rank.
+ * @param elements Filled with the sorted indecies.
+ */
+void slab_elements(const vector<SlabEntry> &slab, vector<int> &elements) {
+    elements.clear();
+    for (auto &d : slab) {
         if (std::get<1>(d) != -1) {
             elements.push_back(std::get<1>(d));
         }
     }
-    return elements;
 }
 
 /**
@@ -103,124 +173,855 @@ vector<int> sort_positions(std::vector<std::tuple<float, int>> depths) {
  * 
  * @param image The Image object to combine the images into.
  * @param cam The Camera object used to capture the images.
+ * @param o_image The buffer receiving the images of other ranks.
+ * @param comm The communicator, ranked front to back.
  */
-void combine_images(Image &image, Camera &cam) {
-    for (int jump = 1; jump < world_size; jump *= 2) {
-        if (world_rank % (jump * 2) == 0) {
-            auto recv_rank = world_rank + jump;
-            if (recv_rank >= world_size) continue;
-            auto o_image = Image(cam);
-            recv_image(o_image, recv_rank);
+void combine_images(Image &image, Camera &cam, Image &o_image,
+                    MPI_Comm comm) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    for (int jump = 1; jump < size; jump *= 2) {
+        if (rank % (jump * 2) == 0) {
+            auto recv_rank = rank + jump;
+            if (recv_rank >= size) continue;
+            o_image.reset(cam);
+            recv_image(o_image, recv_rank, comm);
             image.combine(o_image);
         } else {
-            auto send_rank = world_rank - jump;
-            send_image(image, send_rank);
+            auto send_rank = rank - jump;
+            send_image(image, send_rank, comm);
             break;
         }
     }
 }
 
+/**
+ * Builds the occlusion mask of everything in front of this rank.
+ *
+ * Every rank bounds the transmittance of each tile through its slab, and
+ * the bounds are multiplied front to back with an exclusive prefix scan,
+ * so rank r ends up with the product of ranks 0..r-1. The product of the
+ * bounds bounds the product of the transmittances of every pixel.
+ *
+ * @param cam The full-resolution camera.
+ * @param data The Gaussian data of this rank.
+ * @param tile The size of a mask tile in pixels.
+ * @param comm The communicator, ranked front to back.
+ * @param ctx The render context, whose occlusion mask is filled in and
+ *        whose buffers hold the bound of this rank.
+ * @return The occlusion mask.
+ */
+const OcclusionMask &occlusion_prepass(const Camera &cam,
+                                       const GaussianData &data, int tile,
+                                       MPI_Comm comm, RenderContext &ctx) {
+    TRACE_SCOPE("occlusion_prepass");
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+    auto &mask = ctx.occlusion;
+    mask.reset(cam, tile);
+    auto &own = ctx.occlusion_bound;
+    mask.bound(cam, data, own);
+    MPI_Exscan(own.data(), mask.transmittance.data(),
+               mask.transmittance.size(), MPI_FLOAT, MPI_PROD, comm);
+    if (rank == 0)
+        std::fill(mask.transmittance.begin(), mask.transmittance.end(), 1.f);
+    return mask;
+}
+
+/**
+ * @brief How the work is split between the ranks.
+ */
+enum class Decomposition {
+    SortLast,  ///< Depth slabs per rank, full-frame compositing
+    SortFirst,  ///< Screen bands per rank, splats redistributed, no blending
+    Object      ///< Resident k-d regions per rank, full-frame compositing
+};
+
+/**
+ * @brief The views rendered from the camera of a run.
+ */
+enum class ViewSet {
+    Single,  ///< Only the camera
+    Stereo,  ///< Left and right eye, eye_separation apart
+    Cube     ///< The six square 90 degree faces of a cube map
+};
+
+/**
+ * @brief Options selected on the command line.
+ */
+struct RunOptions {
+    std::string f_name = "data/point_cloud.ply";  ///< PLY file to load
+    std::string output = "img.bmp";  ///< Image file, PPM if it ends in .ppm
+    CompositeMode composite = CompositeMode::Tree;  ///< Compositing backend
+    int occlusion_tile = 0;  ///< Occlusion mask tile size, 0 to disable
+    Decomposition decomposition = Decomposition::SortLast;
+    Balance balance = Balance::Count;  ///< Placement of the slab boundaries
+    int repeat = 1;  ///< Number of times the frame is rendered
+    int steal_rows = 0;  ///< Sort-first tile height for stealing, 0 to disable
+    bool tree_order = false;  ///< Order splats by a spatial tree, not a sort
+    bool morton_layout = true;  ///< Store splats in Morton order after loading
+    int width = 1000, height = 1000;  ///< Image size
+    int camera = 0, cameras = 1;  ///< View camera out of cameras on an orbit
+    OrbitPose pose{{0.0706437, 1.88046, 1.16585}};  ///< Pose of camera 0
+    bool report = true;  ///< Print the phase times on rank 0
+    bool barriers = true;  ///< Synchronize the ranks before every phase
+    std::string trace;  ///< Chrome trace file written at exit, empty if off
+    std::string serve;  ///< Request socket of the server, "-" for stdin
+    std::string path;   ///< Camera path file of the batch mode, empty if off
+    bool cache_scene = false;  ///< Decode the whole file once and keep it
+    ViewSet views = ViewSet::Single;  ///< Views rendered in one pass
+    d_t eye_separation = 0.065;  ///< Distance between the stereo cameras
+    double budget_ms = 0;  ///< Target frame time, 0 to render at full size
+};
+
+/**
+ * @brief Parses the command line.
+ *
+ * Accepted flags are `--file <path>`, `--output <path>`,
+ * `--composite <tree|reduce|reduce_scatter|shared>`,
+ * `--occlusion <tile size>`,
+ * `--decomposition <sort_last|sort_first|object>`,
+ * `--balance <count|cost|feedback>`, `--repeat <n>`,
+ * `--steal <tile rows>`, `--traversal <sort|tree>`,
+ * `--layout <morton|file>`, `--barriers <on|off>`, `--trace <json file>`,
+ * `--serve <socket path|->`, `--path <camera path file>`,
+ * `--views <single|stereo|cube>`, `--eye-separation <distance>`,
+ * `--budget <milliseconds>`, `--resolution <WxH,...>`, `--cameras <n>`
+ * and `--camera <k>`, and for the benchmark mode `--benchmark <json file>`,
+ * `--ranks <n,...>` and `--warmup <n>`. Outside the benchmark mode only the
+ * first resolution and camera k (default 0) of the n cameras are rendered;
+ * the benchmark mode renders all of them unless `--camera` is given. A
+ * frame budget adapts the render size of every frame to the times of the
+ * previous ones; it only works with a single view.
+ *
+ * @param argc The argument count.
+ * @param argv The argument values.
+ * @param opt The options to fill in.
+ * @param bench The benchmark options to fill in.
+ * @return true if all arguments were recognised.
+ */
+bool parse_options(int argc, char **argv, RunOptions &opt,
+                   BenchmarkOptions &bench) {
+    bench.args.assign(argv, argv + argc);
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) return false;
+        if (arg == "--file") {
+            opt.f_name = argv[++i];
+        } else if (arg == "--output") {
+            opt.output = argv[++i];
+        } else if (arg == "--composite") {
+            if (!parse_composite_mode(argv[++i], opt.composite)) return false;
+        } else if (arg == "--occlusion") {
+            if (!parse_number(argv[++i], opt.occlusion_tile) ||
+                opt.occlusion_tile < 0)
+                return false;
+        } else if (arg == "--decomposition") {
+            std::string name = argv[++i];
+            if (name == "sort_last")
+                opt.decomposition = Decomposition::SortLast;
+            else if (name == "sort_first")
+                opt.decomposition = Decomposition::SortFirst;
+            else if (name == "object")
+                opt.decomposition = Decomposition::Object;
+            else
+                return false;
+        } else if (arg == "--balance") {
+            if (!parse_balance(argv[++i], opt.balance)) return false;
+        } else if (arg == "--repeat") {
+            if (!parse_number(argv[++i], opt.repeat) || opt.repeat < 1)
+                return false;
+        } else if (arg == "--steal") {
+            if (!parse_number(argv[++i], opt.steal_rows) || opt.steal_rows < 0)
+                return false;
+        } else if (arg == "--traversal") {
+            std::string name = argv[++i];
+            if (name != "sort" && name != "tree") return false;
+            opt.tree_order = name == "tree";
+        } else if (arg == "--layout") {
+            std::string name = argv[++i];
+            if (name != "morton" && name != "file") return false;
+            opt.morton_layout = name == "morton";
+        } else if (arg == "--barriers") {
+            std::string name = argv[++i];
+            if (name != "on" && name != "off") return false;
+            opt.barriers = name == "on";
+        } else if (arg == "--trace") {
+            opt.trace = argv[++i];
+        } else if (arg == "--serve") {
+            opt.serve = argv[++i];
+        } else if (arg == "--path") {
+            opt.path = argv[++i];
+        } else if (arg == "--views") {
+            std::string name = argv[++i];
+            if (name == "single")
+                opt.views = ViewSet::Single;
+            else if (name == "stereo")
+                opt.views = ViewSet::Stereo;
+            else if (name == "cube")
+                opt.views = ViewSet::Cube;
+            else
+                return false;
+        } else if (arg == "--eye-separation") {
+            if (!parse_number(argv[++i], opt.eye_separation)) return false;
+        } else if (arg == "--budget") {
+            if (!parse_number(argv[++i], opt.budget_ms) || opt.budget_ms < 0)
+                return false;
+        } else if (arg == "--resolution") {
+            if (!parse_resolutions(argv[++i], bench.resolutions)) return false;
+            opt.width = bench.resolutions[0][0];
+            opt.height = bench.resolutions[0][1];
+        } else if (arg == "--benchmark") {
+            bench.output = argv[++i];
+        } else if (arg == "--ranks") {
+            if (!parse_int_list(argv[++i], bench.ranks)) return false;
+        } else if (arg == "--cameras") {
+            if (!parse_number(argv[++i], bench.cameras) || bench.cameras < 1)
+                return false;
+            opt.cameras = bench.cameras;
+        } else if (arg == "--camera") {
+            if (!parse_number(argv[++i], bench.camera) || bench.camera < 0)
+                return false;
+            opt.camera = bench.camera;
+        } else if (arg == "--warmup") {
+            if (!parse_number(argv[++i], bench.warmup) || bench.warmup < 0)
+                return false;
+        } else {
+            return false;
+        }
+    }
+    // Only object regions composite in the right order for any direction.
+    bool multi_ok = opt.views == ViewSet::Single || world_size == 1 ||
+                    opt.decomposition == Decomposition::Object;
+    // The views of a multi-view run are stored without upscaling.
+    bool budget_ok = opt.budget_ms == 0 || opt.views == ViewSet::Single;
+    return opt.camera < opt.cameras && multi_ok && budget_ok;
+}
+
+/**
+ * @brief Composites the per-rank images into the frame on rank 0 with the
+ * selected backend.
+ *
+ * @param ctx The render context; its image is replaced by the composite on
+ *        rank 0.
+ * @param cam The Camera object used to capture the images.
+ * @param mode The compositing backend.
+ * @param comm The communicator, ranked front to back.
+ */
+void composite(RenderContext &ctx, Camera &cam, CompositeMode mode,
+               MPI_Comm comm) {
+    auto &image = ctx.image;
+    if (mode == CompositeMode::Tree) {
+        combine_images(image, cam, ctx.recv_image, comm);
+        return;
+    }
+    if (mode == CompositeMode::Reduce) {
+        ctx.reducer.reduce(image, comm);
+    } else if (mode == CompositeMode::ReduceScatter) {
+        ctx.reducer.reduce_scatter_gather(image, comm);
+    } else {
+        ctx.shared_compositor(comm, image.image.size())
+            .composite(image, ctx.reducer);
+    }
+}
+
+/**
+ * @brief Creates the camera of a run.
+ *
+ * Camera k out of n is opt.pose turned by a further 2 pi k / n around the
+ * vertical axis through its target; camera 0 is the pose itself.
+ *
+ * @param opt The options of the run.
+ */
+Camera make_camera(const RunOptions &opt) {
+    OrbitPose pose = opt.pose;
+    pose.yaw += 2 * (d_t)M_PI * opt.camera / opt.cameras;
+    return pose.camera(opt.width, opt.height);
+}
+
+/**
+ * @brief Creates the cameras of the views of a run.
+ *
+ * The stereo cameras are the camera moved by half the eye separation to
+ * either side. The cube faces share the camera centre and are the camera
+ * turned by 0, 90, 180 and 270 degrees around its vertical axis and by
+ * 90 degrees up and down, each opt.width pixels square.
+ *
+ * @param cam The camera of the run.
+ * @param opt The options of the run.
+ * @param views Filled with the cameras.
+ */
+void make_views(const Camera &cam, const RunOptions &opt,
+                vector<Camera> &views) {
+    views.clear();
+    if (opt.views == ViewSet::Stereo) {
+        for (d_t side : {-0.5f, 0.5f}) {
+            views.push_back(cam);
+            views.back().move_to(v3_t{side * opt.eye_separation, 0, 0});
+        }
+    } else if (opt.views == ViewSet::Cube) {
+        Camera face(opt.width, opt.width, (d_t)M_PI / 2.f);
+        face.r_mat4 = cam.r_mat4;
+        face.update_matrix();
+        for (int k = 0; k < 6; k++) {
+            views.push_back(face);
+            if (k < 4)
+                views.back().pan(k * (d_t)M_PI / 2.f);
+            else
+                views.back().tilt((k == 4 ? 1 : -1) * (d_t)M_PI / 2.f);
+        }
+    } else {
+        views.push_back(cam);
+    }
+}
+
+/**
+ * @brief Prints the spread over the ranks of every phase and work counter
+ * that is not (close to) zero on all ranks.
+ *
+ * @param spread The statistics returned by RankProfile::gather.
+ */
+void print_load_stats(const vector<LoadStats> &spread) {
+    DEBUG_PRINT("Per rank (min / mean / max, slowest rank, max / mean):")
+    for (int i = 0; i < (int)spread.size(); i++) {
+        auto &s = spread[i];
+        bool phase = i < PhaseTimes::Count;
+        if (s.max < (phase ? 0.05 : 1)) continue;
+        const char *name =
+            phase ? PhaseTimes::names[i]
+                  : RankProfile::counter_names[i - PhaseTimes::Count];
+        DEBUG_PRINT("  " << name << ": " << std::fixed
+                         << std::setprecision(phase ? 1 : 0) << s.min << " / "
+                         << s.mean << " / " << s.max << (phase ? "ms" : "")
+                         << ", rank " << s.max_rank << ", "
+                         << std::setprecision(2) << s.imbalance()
+                         << std::defaultfloat << std::setprecision(6))
+    }
+}
+
 /**
  * @brief Runs the main MPI program.
  *
- * @param f_name The name of the PLY file to load.
+ * Every rank times its own phases. With opt.barriers the ranks synchronize
+ * before each phase, so the times of rank 0 are those of the slowest rank;
+ * without, the phases of different ranks overlap and only the per-rank
+ * spread is meaningful.
+ *
+ * @param opt The options of the run.
  * @param barrier_comm The MPI communicator for barrier synchronization.
+ * @param ctx The buffers and state carried between runs.
+ * @param profile If not null, filled with the phase times and work counters
+ *        of this rank.
  * @return int Returns 0 upon successful execution.
  */
-int run(std::string f_name, MPI_Comm barrier_comm) {
-    MPI_Barrier(barrier_comm);
+int run(const RunOptions &opt, MPI_Comm barrier_comm, RenderContext &ctx,
+        RankProfile *profile = nullptr) {
+    auto sync = [&] {
+        if (!opt.barriers) return;
+        TRACE_SCOPE("barrier");
+        MPI_Barrier(barrier_comm);
+    };
+    sync();
+    // Stays -1 when counting is not compiled in, which skips the report.
+    long allocations = heap_allocations();
     ts(open_file);
-    happly::PLYData ply_data(f_name);
+    auto &ply_data = ctx.open(opt.f_name);
+    const GaussianData *scene = opt.cache_scene ? &ctx.decoded() : nullptr;
     ts(done_open_file);
-    Camera cam(1000, 1000, (d_t)M_PI / 2.f);
+    // Under a frame budget the frame is rendered at the size picked from
+    // the previous frames, and upscaled to the output size when stored.
+    int width = opt.width, height = opt.height;
+    if (opt.budget_ms > 0)
+        ctx.budget.size(opt.width, opt.height, width, height);
+    Camera cam = make_camera(opt).resized(width, height);
+    auto &views = ctx.views;
+    make_views(cam, opt, views);
+    bool multi = views.size() > 1;
 
-    cam.move_to({0.0706437, 1.88046, 1.16585, 1});
-    cam.tilt(-(d_t)M_PI / 4.f);
-    cam.tilt((d_t)M_PI / 8.f);
-    cam.move_to(v4_t{0, 0, -1.5});
+    auto &data = ctx.data;
+    bool sort_first = opt.decomposition == Decomposition::SortFirst;
+    bool object = opt.decomposition == Decomposition::Object;
+    bool sort_last = !sort_first && !object;
+    ScreenPartition part(cam, world_size);
 
-    GaussianData data;
-
-    MPI_Barrier(barrier_comm);
+    // Sort-first loads a round-robin share of the splats and then sends them
+    // to the ranks owning the screen bands they cover. The object mode loads
+    // the k-d region of the rank once and keeps it for later frames.
+    sync();
     ts(load_xyz);
-    auto depths = get_elements(ply_data, cam.r_mat4.mat_mul(v4_t{0, 0, 1, 1}));
+    auto &slab = ctx.sorter.mydata;
+    bool by_cost = opt.balance != Balance::Count;
+    bool reload = !object || ctx.resident_file != opt.f_name;
+    if (sort_last)
+        get_elements(
+            ply_data, cam.r_mat4.mat_mul(v4_t{0, 0, 1, 1}), slab,
+            by_cost ? &cam : nullptr,
+            opt.balance == Balance::Feedback ? &ctx.feedback : nullptr, scene);
     ts(done_load_xyz);
 
-    MPI_Barrier(barrier_comm);
+    sync();
     ts(sort_xyz);
-    auto el = sort_positions(depths);
+    if (sort_first) {
+        strided_elements(GaussianData::get_size(ply_data), ctx.elements);
+    } else if (object && reload) {
+        ctx.elements.resize(GaussianData::get_size(ply_data));
+        std::iota(ctx.elements.begin(), ctx.elements.end(), 0);
+        auto xyz = scene ? GaussianData::load_xyz(*scene, ctx.elements)
+                         : GaussianData::load_xyz(ply_data, ctx.elements);
+        ctx.rank_tree.build(xyz, world_size);
+        auto region = ctx.rank_tree.region(world_rank);
+        ctx.elements.assign(region.begin(), region.end());
+    } else if (sort_last) {
+        sort_positions(ctx.sorter, by_cost, ctx.balance_scratch);
+        slab_elements(slab, ctx.elements);
+    }
     ts(done_sort_xyz);
 
-    MPI_Barrier(barrier_comm);
+    sync();
     ts(load);
-    data.load_data(ply_data, el);
+    if (reload && scene)
+        data.load_data(*scene, ctx.elements, opt.morton_layout,
+                       ctx.load_scratch);
+    else if (reload)
+        data.load_data(ply_data, ctx.elements, opt.morton_layout,
+                       ctx.load_scratch);
+    if (object) ctx.resident_file = opt.f_name;
     ts(done_load);
 
-    MPI_Barrier(barrier_comm);
+    sync();
+    ts(exchange);
+    if (sort_first)
+        exchange_splats(data, ctx.exchange_data, cam, part, comm,
+                        ctx.exchange);
+    ts(done_exchange);
+
+    sync();
+    ts(build_tree);
+    const QuadTree *tree = nullptr;
+    if (opt.tree_order) {
+        if (reload)
+            ctx.tree.build(data.x, data.y, data.z,
+                           QuadTree::depth_for(data.size()));
+        tree = &ctx.tree;
+    }
+    ts(done_build_tree);
+
+    // The compositing backends expect the ranks ordered front to back, which
+    // for object regions depends on the camera.
+    MPI_Comm frame_comm =
+        object ? ctx.visibility_comm(comm, world_rank, cam.center()) : comm;
+    int frame_rank;
+    MPI_Comm_rank(frame_comm, &frame_rank);
+
+    sync();
     ts(start_render);
-    auto image = render(cam, data);
+    auto &image = ctx.image;
+    if (multi) {
+        ctx.view_images.resize(views.size());
+        render_views(ctx.view_images, views, data, ctx.view_scratch);
+    } else if (sort_first && opt.steal_rows > 0) {
+        render_band_stealing(image, cam, data, part, opt.steal_rows, comm,
+                             ctx.steal);
+    } else if (sort_first) {
+        render(image,
+               cam.cropped(part.start(world_rank), part.rows(world_rank)),
+               data, ctx.scratch, nullptr, tree);
+    } else if (opt.occlusion_tile > 0) {
+        auto &mask = occlusion_prepass(cam, data, opt.occlusion_tile,
+                                       frame_comm, ctx);
+        render(image, cam, data, ctx.scratch, &mask, tree);
+    } else {
+        render(image, cam, data, ctx.scratch, nullptr, tree);
+    }
     ts(done_render);
+    if (sort_last && opt.balance == Balance::Feedback)
+        ctx.feedback.update(slab, elapsed_ms(start_render, done_render),
+                            comm);
 
-    if (world_rank == 0) {
-        DEBUG_PRINT("Data per process: " << data.xyz.size())
+    if (world_rank == 0 && opt.report) {
+        DEBUG_PRINT("Data per process: " << data.size())
     }
 
-    MPI_Barrier(barrier_comm);
-    ts(comm);
-    combine_images(image, cam);
+    // When every rank ends up owning a part of the finished frame, the parts
+    // are written straight into the output file instead of gathered.
+    bool scaled = width != opt.width || height != opt.height;
+    bool owns_band = sort_first && opt.steal_rows == 0 && !scaled;
+    bool owns_block = !sort_first && !multi && !scaled &&
+                      opt.composite == CompositeMode::ReduceScatter;
+    auto &reducer = ctx.reducer;
+    int block = 0;
+
+    sync();
+    ts(start_comm);
+    auto &view_ranks = ctx.view_ranks;
+    view_ranks.resize(views.size());
+    if (multi) {
+        // Every view composites with the ranks in its own visibility order.
+        for (size_t v = 0; v < views.size(); v++) {
+            MPI_Comm view_comm =
+                object ? ctx.visibility_comm(comm, world_rank,
+                                             views[v].center())
+                       : comm;
+            MPI_Comm_rank(view_comm, &view_ranks[v]);
+            std::swap(image, ctx.view_images[v]);
+            composite(ctx, views[v], opt.composite, view_comm);
+            std::swap(image, ctx.view_images[v]);
+        }
+    } else if (sort_first && !owns_band) {
+        auto &band = ctx.recv_image;
+        std::swap(band, image);
+        image.reset(cam);
+        gather_bands(band, image, part, comm, ctx.exchange);
+        merge_stolen(image, ctx.steal, cam, comm);
+    } else if (owns_block) {
+        block = reducer.reduce_scatter(image, frame_comm);
+    } else if (!sort_first) {
+        composite(ctx, cam, opt.composite, frame_comm);
+    }
     ts(done_comm);
-    if (world_rank == 0) {
+    if (allocations >= 0) allocations = heap_allocations() - allocations;
+
+    int n_pixels = cam.image_size_x * cam.image_size_y;
+    if (multi) {
+        for (size_t v = 0; v < views.size(); v++) {
+            if (view_ranks[v] != 0) continue;
+            TRACE_SCOPE("store_image");
+            ctx.view_images[v].add_background({1, 1, 1});
+            ctx.view_images[v].store_image(numbered_file(opt.output, v));
+        }
+    } else if (owns_band) {
+        image.add_background({1, 1, 1});
+        store_pixels_parallel(opt.output, cam.image_size_x, cam.image_size_y,
+                              part.start(world_rank) * cam.image_size_x,
+                              image.image, comm);
+    } else if (owns_block) {
+        int first = min(n_pixels, frame_rank * block);
+        int count = min(n_pixels, first + block) - first;
+        auto pixels = flatten_rgba(
+            std::span<const v4_t>(reducer.recv_buf).first(count), {1, 1, 1});
+        store_pixels_parallel(opt.output, cam.image_size_x, cam.image_size_y,
+                              first, pixels, frame_comm);
+    } else if (frame_rank == 0 && scaled) {
+        TRACE_SCOPE("store_image");
+        image.add_background({1, 1, 1});
+        upscale(image, ctx.upscaled, opt.width, opt.height, ctx.upscale_rows);
+        ctx.upscaled.store_image(opt.output);
+    } else if (frame_rank == 0) {
+        TRACE_SCOPE("store_image");
         image.add_background({1, 1, 1});
-        image.store_image("img.bmp");
+        image.store_image(opt.output);
     }
-    if (world_rank == 0) {
+    RankProfile local;
+    auto &ms = local.times.ms;
+    ms[PhaseTimes::OpenFile] = elapsed_ms(open_file, done_open_file);
+    ms[PhaseTimes::LoadPositions] = elapsed_ms(load_xyz, done_load_xyz);
+    ms[PhaseTimes::SortPositions] = elapsed_ms(sort_xyz, done_sort_xyz);
+    ms[PhaseTimes::Load] = elapsed_ms(load, done_load);
+    ms[PhaseTimes::Exchange] = elapsed_ms(exchange, done_exchange);
+    ms[PhaseTimes::BuildTree] = elapsed_ms(build_tree, done_build_tree);
+    ms[PhaseTimes::Render] = elapsed_ms(start_render, done_render);
+    ms[PhaseTimes::Communication] = elapsed_ms(start_comm, done_comm);
+    ms[PhaseTimes::Frame] = elapsed_ms(open_file, done_comm);
+    TRACE_SPAN("open_file", open_file, done_open_file);
+    TRACE_SPAN("load_positions", load_xyz, done_load_xyz);
+    TRACE_SPAN("sort_positions", sort_xyz, done_sort_xyz);
+    TRACE_SPAN("load", load, done_load);
+    TRACE_SPAN("exchange", exchange, done_exchange);
+    TRACE_SPAN("build_tree", build_tree, done_build_tree);
+    TRACE_SPAN("render", start_render, done_render);
+    TRACE_SPAN("communication", start_comm, done_comm);
+    TRACE_SPAN("frame", open_file, done_comm);
+    local.counters[RankProfile::SplatsOwned] = data.size();
+    // The stealing and multi-view paths rasterize with their own counters.
+    size_t drawn = ctx.scratch.drawn, blended = ctx.scratch.blended;
+    if (multi)
+        drawn = ctx.view_scratch.drawn, blended = ctx.view_scratch.blended;
+    else if (sort_first && opt.steal_rows > 0)
+        drawn = ctx.steal.drawn, blended = ctx.steal.blended;
+    local.counters[RankProfile::SplatsDrawn] = drawn;
+    local.counters[RankProfile::PixelsBlended] = blended;
+    if (profile) *profile = local;
+
+    if (opt.budget_ms > 0) {
+        // Every rank plans the next frame from the same slowest-rank times.
+        double t[2] = {ms[PhaseTimes::Render] + ms[PhaseTimes::Communication],
+                       ms[PhaseTimes::Frame]};
+        double slowest[2];
+        MPI_Allreduce(t, slowest, 2, MPI_DOUBLE, MPI_MAX, comm);
+        ctx.budget.update(opt.budget_ms, (double)width * height,
+                          (double)opt.width * opt.height, slowest[0],
+                          slowest[1]);
+    }
+
+    vector<LoadStats> spread;
+    if (opt.report) spread = local.gather(comm);
+    long most_allocations = 0;
+    if (opt.report && allocations >= 0)
+        MPI_Reduce(&allocations, &most_allocations, 1, MPI_LONG, MPI_MAX, 0,
+                   comm);
+    if (world_rank == 0 && opt.report) {
         DEBUG_PRINT("Processes: " << world_size)
         DEBUG_PRINT("Open file: " << diff(open_file, done_open_file) << "ms")
         DEBUG_PRINT("Load positions: " << diff(load_xyz, done_load_xyz) << "ms")
         DEBUG_PRINT("Sort positions: " << diff(sort_xyz, done_sort_xyz) << "ms")
         DEBUG_PRINT("Load: " << diff(load, done_load) << "ms")
         DEBUG_PRINT("Render: " << diff(start_render, done_render) << "ms")
-        DEBUG_PRINT("Communication: " << diff(comm, done_comm) << "ms\n")
+        DEBUG_PRINT("Communication: " << diff(start_comm, done_comm) << "ms")
+        if (sort_first) {
+            DEBUG_PRINT("Exchange: " << diff(exchange, done_exchange) << "ms")
+        }
+        if (opt.tree_order) {
+            DEBUG_PRINT("Build tree: " << diff(build_tree, done_build_tree)
+                                       << "ms")
+        }
+        if (opt.budget_ms > 0) {
+            DEBUG_PRINT("Rendered at: " << width << "x" << height
+                                        << ", next scale " << ctx.budget.scale
+                                        << ", predicted "
+                                        << ctx.budget.predicted_ms << "ms")
+        }
+        print_load_stats(spread);
+        DEBUG_PRINT("Peak memory: " << peak_memory_mb() << "MB")
+        if (allocations >= 0) {
+            DEBUG_PRINT("Heap allocations: " << most_allocations
+                                             << " (most on one rank)")
+        }
+        DEBUG_PRINT("")
     }
 
     return 0;
 }
 
+/**
+ * @brief Runs the benchmark sweep and writes one JSON record per rank count,
+ * resolution and camera on rank 0.
+ *
+ * Every rank count n runs on the first n ranks of MPI_COMM_WORLD, split off
+ * into their own communicator, with a fresh RenderContext; the other ranks
+ * wait. Each configuration renders bench.warmup unmeasured frames followed
+ * by opt.repeat measured ones.
+ *
+ * @param opt The options shared by all runs.
+ * @param bench The sweep parameters.
+ * @return int Returns 0 upon successful execution.
+ */
+int benchmark(const RunOptions &opt, const BenchmarkOptions &bench) {
+    int real_rank = world_rank, real_size = world_size;
+    std::ofstream file;
+    if (real_rank == 0 && bench.output != "-")
+        file.open(bench.output, std::ios::app);
+    std::ostream &out = bench.output == "-" ? std::cout : file;
+
+    auto ranks = bench.ranks;
+    if (ranks.empty()) ranks.push_back(real_size);
+    for (int n : ranks) {
+        if (n > real_size) {
+            if (real_rank == 0)
+                DEBUG_PRINT("Skipping " << n << " ranks, only " << real_size
+                                        << " available")
+            continue;
+        }
+        MPI_Comm sub;
+        MPI_Comm_split(MPI_COMM_WORLD, real_rank < n ? 0 : MPI_UNDEFINED,
+                       real_rank, &sub);
+        if (sub != MPI_COMM_NULL) {
+            comm = sub;
+            world_size = n;
+            RenderContext ctx(world_rank, world_size, comm);
+            for (auto [w, h] : bench.resolutions)
+                for (int c = 0; c < bench.cameras; c++) {
+                    if (bench.camera >= 0 && c != bench.camera) continue;
+                    RunOptions o = opt;
+                    o.width = w, o.height = h;
+                    o.camera = c, o.cameras = bench.cameras;
+                    o.report = false;
+                    BenchmarkRecord record;
+                    record.ranks = n, record.camera = c;
+                    record.width = w, record.height = h;
+                    for (int i = 0; i < bench.warmup + opt.repeat; i++) {
+                        RankProfile profile;
+                        auto ret = run(o, comm, ctx, &profile);
+                        if (ret != 0) return ret;
+                        auto spread = profile.gather(comm);
+                        if (i >= bench.warmup && world_rank == 0)
+                            record.frames.push_back(std::move(spread));
+                    }
+                    if (world_rank == 0) {
+                        record.splats = GaussianData::get_size(*ctx.ply_data);
+                        write_benchmark_record(out, bench, record);
+                    }
+                }
+        }
+        if (sub != MPI_COMM_NULL) MPI_Comm_free(&sub);
+        comm = MPI_COMM_WORLD;
+        world_size = real_size;
+        MPI_Barrier(MPI_COMM_WORLD);
+    }
+    return 0;
+}
+
+/**
+ * @brief Runs the render server until a `quit` request or the end of the
+ * requests.
+ *
+ * Rank 0 reads one request per line from opt.serve, a UNIX socket or "-"
+ * for stdin, and broadcasts it. A request is a list of key=value pairs
+ * (see parse_view_request) on top of the command line options; every frame
+ * reuses the parsed and decoded file and the buffers of one RenderContext.
+ * Rank 0 answers each request with "ok <output> <milliseconds>" once the
+ * image is written, or with "error <reason>".
+ *
+ * @param opt The options of the server, the defaults of every request.
+ * @return int Returns 0 upon successful execution.
+ */
+int serve(const RunOptions &opt) {
+    RequestChannel channel;
+    int listening = world_rank != 0 || channel.open(opt.serve);
+    MPI_Bcast(&listening, 1, MPI_INT, 0, comm);
+    if (!listening) {
+        if (world_rank == 0) DEBUG_PRINT("Cannot listen on " << opt.serve)
+        return 1;
+    }
+
+    RenderContext ctx(world_rank, world_size);
+    ctx.open(opt.f_name);
+    RunOptions o = opt;
+    o.report = false;
+    o.camera = 0, o.cameras = 1;
+    o.cache_scene = true;
+    while (true) {
+        ViewRequest req{opt.width, opt.height, opt.pose, opt.output};
+        int render_frame = 0;
+        if (world_rank == 0) {
+            std::string line, word, error;
+            while (channel.next_line(line)) {
+                std::istringstream(line) >> word;
+                if (word == "quit") break;
+                ViewRequest parsed = req;
+                if (parse_view_request(line, parsed, error)) {
+                    req = parsed;
+                    render_frame = 1;
+                    break;
+                }
+                channel.reply("error " + error);
+            }
+        }
+        MPI_Bcast(&render_frame, 1, MPI_INT, 0, comm);
+        if (!render_frame) break;
+        broadcast_request(req, comm);
+
+        o.width = req.width, o.height = req.height;
+        o.pose = req.pose;
+        o.output = req.output;
+        ts(start);
+        auto ret = run(o, MPI_COMM_WORLD, ctx);
+        if (ret != 0) return ret;
+        // The image may be written by another rank than 0.
+        MPI_Barrier(comm);
+        ts(done);
+        if (world_rank == 0) {
+            std::ostringstream reply;
+            reply << "ok " << req.output << ' ' << std::fixed
+                  << std::setprecision(1) << elapsed_ms(start, done);
+            channel.reply(reply.str());
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Renders every frame of the camera path opt.path into numbered
+ * images named after opt.output, and prints the throughput on rank 0.
+ *
+ * The file is parsed and decoded once, and all frames reuse the buffers of
+ * one RenderContext.
+ *
+ * @param opt The options of the run, the defaults of the path.
+ * @return int Returns 0 upon successful execution.
+ */
+int render_path(const RunOptions &opt) {
+    vector<ViewRequest> frames;
+    std::string error;
+    if (!read_camera_path(opt.path,
+                          {opt.width, opt.height, opt.pose, opt.output},
+                          frames, error)) {
+        if (world_rank == 0) DEBUG_PRINT(error)
+        return 1;
+    }
+
+    RenderContext ctx(world_rank, world_size);
+    RunOptions o = opt;
+    o.report = false;
+    o.camera = 0, o.cameras = 1;
+    o.cache_scene = true;
+    MPI_Barrier(comm);
+    ts(start);
+    for (size_t i = 0; i < frames.size(); i++) {
+        o.width = frames[i].width, o.height = frames[i].height;
+        o.pose = frames[i].pose;
+        o.output = numbered_file(opt.output, i);
+        auto ret = run(o, MPI_COMM_WORLD, ctx);
+        if (ret != 0) return ret;
+    }
+    MPI_Barrier(comm);
+    ts(done);
+    if (world_rank == 0) {
+        double s = elapsed_ms(start, done) / 1000;
+        DEBUG_PRINT("Frames: " << frames.size() << " in " << s << "s, "
+                               << frames.size() / s << " frames/s")
+    }
+    return 0;
+}
+
 int main(int argc, char **argv) {
     MPI_Init(&argc, &argv);
     MPI_Comm_size(comm, &world_size);
     MPI_Comm_rank(comm, &world_rank);
 
-    auto ret = run("data/point_cloud.ply", MPI_COMM_WORLD);
-    if (ret != 0) return ret;
+    RunOptions opt;
+    BenchmarkOptions bench;
+    if (!parse_options(argc, argv, opt, bench)) {
+        if (world_rank == 0) {
+            DEBUG_PRINT("Usage: " << argv[0] << " [--file <path>]"
+                        << " [--output <path>]"
+                        << " [--composite <tree|reduce|reduce_scatter|shared>]"
+                        << " [--occlusion <tile size>]"
+                        << " [--decomposition <sort_last|sort_first|object>]"
+                        << " [--balance <count|cost|feedback>] [--repeat <n>]"
+                        << " [--steal <tile rows>] [--traversal <sort|tree>]"
+                        << " [--layout <morton|file>] [--barriers <on|off>]"
+                        << " [--trace <json file>]"
+                        << " [--serve <socket path|->]"
+                        << " [--path <camera path file>]"
+                        << " [--views <single|stereo|cube>]"
+                        << " [--eye-separation <distance>]"
+                        << " [--budget <milliseconds>]"
+                        << " [--resolution <WxH,...>]"
+                        << " [--benchmark <json file>] [--ranks <n,...>]"
+                        << " [--cameras <n>] [--camera <k>] [--warmup <n>]")
+        }
+        MPI_Finalize();
+        return 1;
+    }
+
+    int ret = 0;
+    if (!bench.output.empty()) {
+        ret = benchmark(opt, bench);
+    } else if (!opt.serve.empty()) {
+        ret = serve(opt);
+    } else if (!opt.path.empty()) {
+        ret = render_path(opt);
+    } else {
+        RenderContext ctx(world_rank, world_size);
+        for (int i = 0; i < opt.repeat && ret == 0; i++)
+            ret = run(opt, MPI_COMM_WORLD, ctx);
+    }
+
+    if (!opt.trace.empty() && !write_trace(opt.trace, MPI_COMM_WORLD) &&
+        world_rank == 0)
+        DEBUG_PRINT("Tracing is not compiled in, rebuild with -DTRACE")
 
     MPI_Finalize();
-    return 0;
+    return ret;
 }
-
-// *******************************
-// FOR BENCHMARKING ON DARDEL
-// *******************************
-// int main(int argc, char **argv) {
-//     MPI_Init(&argc, &argv);
-//     MPI_Comm_size(comm, &world_size);
-//     MPI_Comm_rank(comm, &world_rank);
-//     int real_size = world_size;
-//     for (world_size = 1; world_size <= real_size; world_size++) {
-//         MPI_Comm barrier_comm;
-//         if (world_rank < world_size) {
-//             MPI_Comm_split(MPI_COMM_WORLD, 0, world_rank, &barrier_comm);
-//             for (int i = 0; i < 5; i++) {
-//                 auto ret = run("data/point_cloud.ply", barrier_comm);
-//                 if (ret != 0) return ret;
-//             }
-//         } else {
-//             MPI_Comm_split(MPI_COMM_WORLD, MPI_UNDEFINED, world_rank,
-//                            &barrier_comm);
-//         }
-//         MPI_Barrier(MPI_COMM_WORLD);
-//     }
-
-//     MPI_Finalize();
-//     return 0;
-// }
\ No newline at end of file
@@ -0,0 +1,76 @@
+#ifndef MORTON_IMPORT
+#define MORTON_IMPORT 1
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "default_types.hpp"
+
+/**
+ * @brief Spreads the lowest 21 bits of v so that two zero bits follow each
+ * of them.
+ */
+inline uint64_t spread_bits(uint64_t v) {
+    v &= 0x1fffff;
+    v = (v | v << 32) & 0x1f00000000ffff;
+    v = (v | v << 16) & 0x1f0000ff0000ff;
+    v = (v | v << 8) & 0x100f00f00f00f00f;
+    v = (v | v << 4) & 0x10c30c30c30c30c3;
+    v = (v | v << 2) & 0x1249249249249249;
+    return v;
+}
+
+/**
+ * @brief Interleaves three 21-bit grid coordinates into a Morton code.
+ */
+inline uint64_t morton_code(uint32_t x, uint32_t y, uint32_t z) {
+    return spread_bits(x) | spread_bits(y) << 1 | spread_bits(z) << 2;
+}
+
+/**
+ * Orders positions along the Morton curve through their bounding box, so
+ * that positions close in space end up close in the order.
+ *
+ * @param pos The positions.
+ * @param order Filled with the indices of pos in curve order; ties keep
+ *        their index order.
+ * @param keys Scratch for the codes, reused between calls.
+ */
+void morton_order(const vector<v4_t> &pos, vector<int> &order,
+                  vector<std::pair<uint64_t, int>> &keys) {
+    v4_t mn{MAXFLOAT, MAXFLOAT, MAXFLOAT, 0};
+    v4_t mx{-MAXFLOAT, -MAXFLOAT, -MAXFLOAT, 0};
+    for (auto &p : pos)
+        for (int a = 0; a < 3; a++) {
+            mn[a] = min(mn[a], p[a]);
+            mx[a] = max(mx[a], p[a]);
+        }
+    const d_t cells = (1 << 21) - 1;
+    d_t scale[3];
+    for (int a = 0; a < 3; a++)
+        scale[a] = mx[a] > mn[a] ? cells / (mx[a] - mn[a]) : 0;
+
+    keys.resize(pos.size());
+    for (size_t i = 0; i < pos.size(); i++) {
+        uint32_t g[3];
+        for (int a = 0; a < 3; a++)
+            g[a] = min(cells, (pos[i][a] - mn[a]) * scale[a]);
+        keys[i] = {morton_code(g[0], g[1], g[2]), (int)i};
+    }
+    std::sort(keys.begin(), keys.end());
+
+    order.resize(pos.size());
+    for (size_t i = 0; i < keys.size(); i++) order[i] = keys[i].second;
+}
+
+/**
+ * @brief Orders positions along the Morton curve, with a scratch of its own.
+ */
+void morton_order(const vector<v4_t> &pos, vector<int> &order) {
+    vector<std::pair<uint64_t, int>> keys;
+    morton_order(pos, order, keys);
+}
+
+#endif
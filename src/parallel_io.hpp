@@ -0,0 +1,88 @@
+#ifndef PARALLEL_IO_IMPORT
+#define PARALLEL_IO_IMPORT 1
+
+#include <mpi.h>
+
+#include <span>
+#include <string>
+
+#include "generate_image.hpp"
+#include "trace.hpp"
+
+/**
+ * Applies a background colour to packed RGBA pixels.
+ *
+ * @param rgba The pixels, with the transmittance in the last channel.
+ * @param background The background colour.
+ * @return The opaque pixel colours.
+ */
+vector<v3_t> flatten_rgba(std::span<const v4_t> rgba, v3_t background) {
+    vector<v3_t> out(rgba.size());
+    for (size_t i = 0; i < rgba.size(); i++)
+        out[i] = v3_t{rgba[i][0], rgba[i][1], rgba[i][2]} +
+                 background * rgba[i][3];
+    return out;
+}
+
+/**
+ * Writes a contiguous range of pixels of the frame straight into a shared
+ * image file with collective MPI-IO, so that the frame never has to be
+ * gathered on one rank.
+ *
+ * Every rank of the communicator must call this, and the ranges of all ranks
+ * together must cover the frame. The range is split at row ends into one
+ * file segment per row (merged when the rows are not padded), described by
+ * an hindexed file view and written with MPI_File_write_at_all. Rank 0 also
+ * writes the header.
+ *
+ * @param file_name The name of the file; see ImageFormat for the format.
+ * @param w, h The size of the full frame.
+ * @param first The index y * w + x of the first pixel of the range.
+ * @param pixels The opaque pixel colours of the range.
+ * @param comm The communicator.
+ */
+void store_pixels_parallel(const std::string &file_name, int w, int h,
+                           size_t first, std::span<const v3_t> pixels,
+                           MPI_Comm comm) {
+    TRACE_SCOPE("store_pixels_parallel");
+    ImageFormat fmt(file_name, w, h);
+    std::string hdr = fmt.header();
+
+    vector<char> buf(3 * pixels.size());
+    vector<int> lens;
+    vector<MPI_Aint> displs;
+    for (size_t i = 0; i < pixels.size();) {
+        size_t p = first + i;
+        int y = p / w, x = p % w;
+        size_t n = min(pixels.size() - i, (size_t)(w - x));
+        MPI_Aint displ = hdr.size() + y * fmt.row_stride() + 3 * x;
+        if (!displs.empty() && displs.back() + lens.back() == displ)
+            lens.back() += 3 * n;
+        else
+            displs.push_back(displ), lens.push_back(3 * n);
+        for (size_t k = i; k < i + n; k++) fmt.encode(pixels[k], &buf[3 * k]);
+        i += n;
+    }
+
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+    MPI_File fh;
+    MPI_File_open(comm, file_name.c_str(), MPI_MODE_CREATE | MPI_MODE_WRONLY,
+                  MPI_INFO_NULL, &fh);
+    MPI_File_set_size(fh, fmt.file_size());
+    if (rank == 0)
+        MPI_File_write_at(fh, 0, hdr.data(), hdr.size(), MPI_BYTE,
+                          MPI_STATUS_IGNORE);
+
+    MPI_Datatype file_type;
+    MPI_Type_create_hindexed(lens.size(), lens.data(), displs.data(), MPI_BYTE,
+                             &file_type);
+    MPI_Type_commit(&file_type);
+    MPI_File_set_view(fh, 0, MPI_BYTE, file_type, "native", MPI_INFO_NULL);
+    MPI_File_write_at_all(fh, 0, buf.data(), buf.size(), MPI_BYTE,
+                          MPI_STATUS_IGNORE);
+    MPI_Type_free(&file_type);
+    MPI_File_close(&fh);
+}
+
+#endif
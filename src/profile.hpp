@@ -0,0 +1,110 @@
+#ifndef PROFILE_IMPORT
+#define PROFILE_IMPORT 1
+
+#include <mpi.h>
+
+#include <array>
+#include <chrono>
+#include <vector>
+
+/**
+ * @brief Wall-clock time of the phases of one frame, in milliseconds.
+ */
+struct PhaseTimes {
+    enum Phase {
+        OpenFile,
+        LoadPositions,
+        SortPositions,
+        Load,
+        Exchange,
+        BuildTree,
+        Render,
+        Communication,
+        Frame,  ///< From opening the file to the end of the communication
+        Count
+    };
+    static constexpr const char *names[Count] = {
+        "open_file", "load_positions", "sort_positions",
+        "load",      "exchange",       "build_tree",
+        "render",    "communication",  "frame"};
+
+    std::array<double, Count> ms{};
+};
+
+/**
+ * @brief Milliseconds between two time points.
+ */
+template <typename T>
+double elapsed_ms(const T &t1, const T &t2) {
+    return std::chrono::duration<double, std::milli>(t2 - t1).count();
+}
+
+/**
+ * @brief Spread of one measured quantity over the ranks.
+ */
+struct LoadStats {
+    double min = 0, mean = 0, max = 0;
+    int max_rank = 0;  ///< A rank holding the maximum
+
+    /**
+     * @brief Ratio of the largest value to the mean, 1 when balanced.
+     */
+    double imbalance() const { return mean > 0 ? max / mean : 1; }
+};
+
+/**
+ * @brief What one rank measured during a frame: its own phase times and
+ * how much work it did.
+ */
+struct RankProfile {
+    enum Counter {
+        SplatsOwned,    ///< Splats held by the rank
+        SplatsDrawn,    ///< Splats that covered at least one pixel
+        PixelsBlended,  ///< Pixel updates of all drawn splats
+        Count
+    };
+    static constexpr const char *counter_names[Count] = {
+        "splats_owned", "splats_drawn", "pixels_blended"};
+
+    PhaseTimes times;
+    std::array<double, Count> counters{};
+
+    /**
+     * Gathers the profiles of all ranks on rank 0. Collective over comm.
+     *
+     * @param comm The communicator of the ranks.
+     * @return On rank 0, the spread of every phase time followed by the
+     *         spread of every counter; empty on the other ranks.
+     */
+    std::vector<LoadStats> gather(MPI_Comm comm) const {
+        int rank, size;
+        MPI_Comm_rank(comm, &rank);
+        MPI_Comm_size(comm, &size);
+        constexpr int n = int(PhaseTimes::Count) + int(Count);
+        std::array<double, n> local;
+        for (int i = 0; i < PhaseTimes::Count; i++) local[i] = times.ms[i];
+        for (int i = 0; i < Count; i++)
+            local[PhaseTimes::Count + i] = counters[i];
+
+        std::vector<double> all(rank == 0 ? n * size : 0);
+        MPI_Gather(local.data(), n, MPI_DOUBLE, all.data(), n, MPI_DOUBLE, 0,
+                   comm);
+        std::vector<LoadStats> stats;
+        if (rank != 0) return stats;
+        stats.resize(n);
+        for (int i = 0; i < n; i++) {
+            auto &s = stats[i];
+            s.min = s.max = all[i];
+            for (int r = 0; r < size; r++) {
+                double v = all[r * n + i];
+                s.mean += v;
+                if (v < s.min) s.min = v;
+                if (v > s.max) s.max = v, s.max_rank = r;
+            }
+            s.mean /= size;
+        }
+        return stats;
+    }
+};
+
+#endif
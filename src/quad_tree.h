@@ -1,68 +1,114 @@
-#include<vector>
-using vector = std::vector;
-struct QuadNode {
-    std::span<int> idx;
-    v4_t mn, mx;
-    QuadNode(std::span<int> idx, std::vector<v4_t> const &xyz)
-        : idx(idx), mn(MAXFLOAT + v4_t{0}), mx(MAXFLOAT * -1 + v4_t{0}) {
-        for (auto i : idx) {
-            mn = min(xyz[i], mn);
-            mx = max(xyz[i], mx);
-        }
-    }
-};
+#ifndef QUAD_TREE_IMPORT
+#define QUAD_TREE_IMPORT 1
+
+#include <algorithm>
+#include <bit>
+#include <numeric>
+#include <span>
+#include <vector>
+
+#include "default_types.hpp"
+
+/**
+ * @brief Spatial tree over splat positions that yields a view-dependent
+ * front-to-back order of its leaves without sorting.
+ *
+ * Every level halves each node at the median along x, y and z in turn. The
+ * nodes are stored in heap order: node k has the children 2k + 1 (below the
+ * cut) and 2k + 2 (above it), and the leaves are the nodes of the last
+ * level. Visiting the child on the camera's side of each cut first gives the
+ * leaves front to back for any camera position.
+ */
 struct QuadTree {
-    vector<int> idx;
-    vector<QuadNode> children;
-    vector<vector<v4_t>> cuts;
-    const v4_t dirs[3] = {v4_t{1, 0, 0, 0}, v4_t{0, 1, 0, 0}, v4_t{0, 0, 1, 0}}; 
-    int depth;
-    QuadTree(int _depth, const vector<v4_t> &xyz): depth(_depth) {
-        idx = vector<int>(xyz.size());
+    int depth = 0;
+    vector<int> idx;         ///< Splat indices, grouped by leaf
+    vector<int> leaf_start;  ///< Leaf l holds idx[leaf_start[l], leaf_start[l + 1])
+    vector<d_t> cuts;        ///< Cut coordinate of each inner node
+
+    /**
+     * @brief Picks a depth that leaves about leaf_size splats per leaf.
+     */
+    static int depth_for(size_t n, size_t leaf_size = 256) {
+        int d = 0;
+        while ((n >> d) > leaf_size) d++;
+        return d;
+    }
+
+    /**
+     * @brief Builds the tree, replacing the previous one.
+     *
+     * @param x, y, z The splat positions.
+     * @param depth_ The number of levels of cuts.
+     */
+    void build(std::span<const d_t> x, std::span<const d_t> y,
+               std::span<const d_t> z, int depth_) {
+        depth = depth_;
+        const std::span<const d_t> axes[3] = {x, y, z};
+        idx.resize(x.size());
         std::iota(idx.begin(), idx.end(), 0);
-        vector<vector<std::span<int>>> views;
-        views.push_back({std::span<int>(idx)});
-        for (int i = 0; i < depth; i++) {
-            views.push_back({});
-            cuts.push_back({});
-            auto dir = dirs[i % 3];
-            for (auto v : views[i]) {
-                sort_span_in_direction(xyz, dir, v);
-                auto s1 = v.subspan(0, v.size() / 2);
-                auto s2 = v.subspan(v.size() / 2);
-                views[i + 1].push_back(s1);
-                views[i + 1].push_back(s2);
-                cuts[i].push_back({xyz[s1.back()]});
+        cuts.assign((1 << depth) - 1, 0);
+
+        // Node ranges of the current level, in heap order.
+        leaf_start.assign((1 << depth) + 1, 0);
+        leaf_start[1] = idx.size();
+        for (int level = 0; level < depth; level++) {
+            auto pos = axes[level % 3];
+            int nodes = 1 << level;
+            for (int j = nodes - 1; j >= 0; j--) {
+                int start = leaf_start[j], end = leaf_start[j + 1];
+                int mid = (start + end) / 2;
+                if (start < end) {
+                    std::nth_element(idx.begin() + start, idx.begin() + mid,
+                                     idx.begin() + end, [&pos](int a, int b) {
+                                         return pos[a] < pos[b];
+                                     });
+                    cuts[nodes - 1 + j] = pos[idx[mid]];
+                }
+                leaf_start[2 * j + 2] = end;
+                leaf_start[2 * j + 1] = mid;
             }
-        }
-        for (auto v : views[depth]) {
-            children.emplace_back(v, xyz);
+            leaf_start[0] = 0;
         }
     }
-    vector<int> order(v4_t camera_pos){
-        vector<vector<std::tuple<int, int>>> sorted_ranges({{std::tuple<int, int>(0, children.size())}});
-        for (int i = 0; i < depth; i++) {
-            auto dir = dirs[i % 3];
-            vector<std::tuple<int, int>> new_range = {};
-            for(size_t j = 0; j < cuts[i].size(); j++){
-                auto [start, end] = sorted_ranges.back()[j];
-                int mid = (start + end) / 2;
-                std::tuple<int, int>first_half = {start, mid}, second_half = {mid, end};
 
-                if (camera_pos.dot(dir) > cuts[i][j].dot(dir)){
-                    new_range.push_back(first_half);
-                    new_range.push_back(second_half);
-                }else{
-                    new_range.push_back(second_half);
-                    new_range.push_back(first_half);
-                }
+    /**
+     * @brief Number of leaves.
+     */
+    int leaves() const { return 1 << depth; }
+
+    /**
+     * @brief Splat indices of a leaf.
+     */
+    std::span<const int> leaf(int l) const {
+        return std::span<const int>(idx).subspan(
+            leaf_start[l], leaf_start[l + 1] - leaf_start[l]);
+    }
+
+    /**
+     * @brief Lists the leaves front to back as seen from a camera position.
+     *
+     * @param camera_pos The camera position in world coordinates.
+     * @param result Filled with the leaf indices.
+     */
+    void order(const v4_t &camera_pos, vector<int> &result) const {
+        result.clear();
+        int stack[64], top = 0;
+        stack[top++] = 0;
+        int inner = (1 << depth) - 1;
+        while (top > 0) {
+            int k = stack[--top];
+            if (k >= inner) {
+                result.push_back(k - inner);
+                continue;
             }
-            sorted_ranges.push_back(new_range);
+            int level = std::bit_width(unsigned(k + 1)) - 1;
+            bool above = camera_pos[level % 3] >= cuts[k];
+            // The far child goes on the stack first so the near one is
+            // visited first.
+            stack[top++] = above ? 2 * k + 1 : 2 * k + 2;
+            stack[top++] = above ? 2 * k + 2 : 2 * k + 1;
         }
-        vector<int> result;
-        for(auto [start, _end] : sorted_ranges.back()){
-            result.push_back(start);
-        }
-        return result;
     }
 };
+
+#endif
@@ -0,0 +1,144 @@
+#ifndef RENDER_CONTEXT_IMPORT
+#define RENDER_CONTEXT_IMPORT 1
+
+#include <mpi.h>
+
+#include <memory>
+#include <string>
+
+#include "composite.hpp"
+#include "frame_budget.hpp"
+#include "generate_image.hpp"
+#include "kd_decomposition.hpp"
+#include "load_balance.hpp"
+#include "sort_first.hpp"
+#include "transpose_sort.cpp"
+#include "work_steal.hpp"
+
+/**
+ * @brief Everything a rank keeps from one frame to the next.
+ *
+ * The buffers are sized by the first frame and only grow when a later frame
+ * needs more, so rendering the same scene again, from any camera, reuses
+ * their storage instead of allocating it. Owns MPI objects, so it must be
+ * created after MPI_Init and destroyed before MPI_Finalize.
+ */
+struct RenderContext {
+    std::string f_name;                         ///< File of ply_data
+    std::unique_ptr<happly::PLYData> ply_data;  ///< Parsed once per file
+    GaussianData scene;          ///< All splats of decoded_file, if used
+    std::string decoded_file;    ///< File decoded into scene, if any
+    GaussianData data;           ///< Splats rendered by this rank
+    GaussianData exchange_data;  ///< Receive side of the sort-first exchange
+    ExchangeScratch exchange;    ///< Buffers of the sort-first exchange
+    StealScratch steal;          ///< Buffers of the sort-first stealing
+    SortEngine<SlabEntry> sorter;        ///< Depth sort, mydata is the slab
+    BalanceScratch balance_scratch;      ///< Buffers of balance_by_cost
+    vector<int> elements;                ///< Element indices to load
+    LoadScratch load_scratch;            ///< Order buffers of load_data
+    Image image;                 ///< The frame
+    Image recv_image;            ///< Receive side of the tree compositing
+    vector<Camera> views;        ///< The cameras of the frame
+    vector<int> view_ranks;      ///< Rank in the compositing of each view
+    vector<Image> view_images;   ///< The frames of a multi-view run
+    MultiViewScratch view_scratch;  ///< Scratch of render_views
+    FrameBudget budget;          ///< Render size planning, if enabled
+    Image upscaled;              ///< The frame upscaled to the output size
+    vector<v3_t> upscale_rows;   ///< Scratch of upscale
+    RenderScratch scratch;       ///< Scratch of render
+    OcclusionMask occlusion;     ///< Mask of the occlusion pre-pass
+    vector<float> occlusion_bound;  ///< Tile bounds of this rank's slab
+    QuadTree tree;               ///< Spatial tree over data, if enabled
+    OverReducer reducer;         ///< Collective compositing buffers
+    std::unique_ptr<SharedCompositor> compositor;  ///< Created on first use
+    CostFeedback feedback;       ///< Cost model corrections
+    RankTree rank_tree;          ///< Object-space regions of the ranks
+    std::string resident_file;   ///< File whose region data holds, if any
+    vector<int> rank_order;      ///< Ranks front to back, this frame
+    vector<int> comm_order;      ///< Rank order of visible_comm
+    MPI_Comm visible_comm = MPI_COMM_NULL;  ///< Ranks in comm_order
+
+    /**
+     * @param rank The rank of this process in comm.
+     * @param size The size of comm.
+     * @param comm The communicator the frames are rendered by.
+     */
+    RenderContext(int rank, int size, MPI_Comm comm = MPI_COMM_WORLD)
+        : sorter(rank, size, comm) {}
+
+    ~RenderContext() {
+        compositor.reset();
+        if (visible_comm != MPI_COMM_NULL) MPI_Comm_free(&visible_comm);
+    }
+
+    RenderContext(const RenderContext &) = delete;
+    RenderContext &operator=(const RenderContext &) = delete;
+
+    /**
+     * @brief Returns the parsed PLY file, reading it only when it differs
+     * from the file of the previous frame.
+     */
+    happly::PLYData &open(const std::string &name) {
+        if (!ply_data || name != f_name) {
+            ply_data = std::make_unique<happly::PLYData>(name);
+            f_name = name;
+        }
+        return *ply_data;
+    }
+
+    /**
+     * @brief Returns all splats of the open file decoded, in file order,
+     * decoding them only when the file differs from the one of the previous
+     * call. Costs the memory of the whole scene on every rank.
+     */
+    const GaussianData &decoded() {
+        if (decoded_file != f_name) {
+            vector<int> all(GaussianData::get_size(*ply_data));
+            std::iota(all.begin(), all.end(), 0);
+            scene.load_data(*ply_data, all, false);
+            decoded_file = f_name;
+        }
+        return scene;
+    }
+
+    /**
+     * @brief Returns the shared-memory compositor, creating its window on
+     * first use or when the image size changes.
+     *
+     * @param comm The communicator, ranked front to back.
+     * @param n_pixels The number of pixels of each image.
+     */
+    SharedCompositor &shared_compositor(MPI_Comm comm, size_t n_pixels) {
+        if (!compositor || compositor->n_pixels != n_pixels)
+            compositor = std::make_unique<SharedCompositor>(comm, n_pixels);
+        return *compositor;
+    }
+
+    /**
+     * @brief Returns a communicator with the ranks ordered front to back
+     * for a camera position, by the regions of rank_tree.
+     *
+     * A new communicator is only split when the order differs from the one
+     * of the previous call. Collective over comm.
+     *
+     * @param comm The communicator rank_tree was built for.
+     * @param rank The rank of this process in comm.
+     * @param camera_pos The camera position in world coordinates.
+     */
+    MPI_Comm visibility_comm(MPI_Comm comm, int rank,
+                             const v4_t &camera_pos) {
+        rank_tree.order(camera_pos, rank_order);
+        if (visible_comm == MPI_COMM_NULL || rank_order != comm_order) {
+            // The compositor window belongs to the old communicator.
+            compositor.reset();
+            if (visible_comm != MPI_COMM_NULL) MPI_Comm_free(&visible_comm);
+            int key = std::find(rank_order.begin(), rank_order.end(), rank) -
+                      rank_order.begin();
+            MPI_Comm_split(comm, 0, key, &visible_comm);
+            comm_order = rank_order;
+        }
+        return visible_comm;
+    }
+};
+
+#endif
@@ -0,0 +1,207 @@
+#ifndef SERVER_IMPORT
+#define SERVER_IMPORT 1
+
+#include <mpi.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <string>
+
+#include "camera.hpp"
+
+/**
+ * @brief One frame asked of the render server.
+ */
+struct ViewRequest {
+    int width = 1000, height = 1000;
+    OrbitPose pose;
+    std::string output;  ///< Image file the frame is written to
+};
+
+/**
+ * Parses a request line of space separated key=value pairs, on top of the
+ * values already in req. Keys are `width`, `height`, `fov`, `yaw`, `pitch`
+ * (degrees), `distance`, `target` (x,y,z) and `output`.
+ *
+ * @param line The request line.
+ * @param req The request to update.
+ * @param error Set to a description of the first bad pair.
+ * @return true if every pair was valid.
+ */
+bool parse_view_request(const std::string &line, ViewRequest &req,
+                        std::string &error) {
+    std::stringstream ss(line);
+    std::string item;
+    const d_t deg = (d_t)M_PI / 180;
+    while (ss >> item) {
+        auto eq = item.find('=');
+        std::string key = item.substr(0, eq);
+        std::string value = eq == std::string::npos ? "" : item.substr(eq + 1);
+        try {
+            size_t end = 0;
+            if (key == "width") {
+                req.width = std::stoi(value, &end);
+            } else if (key == "height") {
+                req.height = std::stoi(value, &end);
+            } else if (key == "fov") {
+                req.pose.fov_x = std::stof(value, &end) * deg;
+            } else if (key == "yaw") {
+                req.pose.yaw = std::stof(value, &end) * deg;
+            } else if (key == "pitch") {
+                req.pose.pitch = std::stof(value, &end) * deg;
+            } else if (key == "distance") {
+                req.pose.distance = std::stof(value, &end);
+            } else if (key == "target") {
+                float x, y, z;
+                int n;
+                if (sscanf(value.c_str(), "%f,%f,%f%n", &x, &y, &z, &n) != 3)
+                    throw std::invalid_argument(value);
+                req.pose.target = v3_t{x, y, z};
+                end = n;
+            } else if (key == "output") {
+                req.output = value;
+                end = value.size();
+            } else {
+                error = "unknown key " + key;
+                return false;
+            }
+            if (end != value.size() || value.empty())
+                throw std::invalid_argument(value);
+        } catch (const std::exception &) {
+            error = "bad value for " + key;
+            return false;
+        }
+    }
+    if (req.width < 1 || req.height < 1 || req.output.empty() ||
+        !(req.pose.fov_x > 0 && req.pose.fov_x < (d_t)M_PI)) {
+        error = "invalid size, field of view or output";
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Sends a request from root to all ranks. Collective over comm.
+ *
+ * @param req The request, overwritten on the other ranks.
+ * @param comm The communicator of the ranks.
+ * @param root The rank holding the request.
+ */
+void broadcast_request(ViewRequest &req, MPI_Comm comm, int root = 0) {
+    int sizes[3] = {req.width, req.height, (int)req.output.size()};
+    MPI_Bcast(sizes, 3, MPI_INT, root, comm);
+    req.width = sizes[0], req.height = sizes[1];
+    req.output.resize(sizes[2]);
+    MPI_Bcast(req.output.data(), sizes[2], MPI_CHAR, root, comm);
+
+    auto &p = req.pose;
+    d_t pose[7] = {p.target[0], p.target[1], p.target[2], p.yaw,
+                   p.pitch,     p.distance,  p.fov_x};
+    MPI_Bcast(pose, 7 * sizeof(d_t), MPI_BYTE, root, comm);
+    p.target = v3_t{pose[0], pose[1], pose[2]};
+    p.yaw = pose[3], p.pitch = pose[4], p.distance = pose[5];
+    p.fov_x = pose[6];
+}
+
+/**
+ * @brief Line-based request channel of the server on rank 0: stdin and
+ * stdout, or a UNIX socket that takes one client at a time.
+ */
+struct RequestChannel {
+    int listen_fd = -1;  ///< Listening socket, -1 for stdin
+    int in = 0, out = 1;  ///< Descriptors of the current client
+    std::string buffer;  ///< Read but not yet returned
+
+    RequestChannel() = default;
+    RequestChannel(const RequestChannel &) = delete;
+    RequestChannel &operator=(const RequestChannel &) = delete;
+
+    ~RequestChannel() {
+        if (listen_fd < 0) return;
+        if (in >= 0) close(in);
+        close(listen_fd);
+    }
+
+    /**
+     * Opens the channel.
+     *
+     * @param path "-" for stdin and stdout, otherwise the path of the UNIX
+     *        socket to create.
+     * @return false if the socket could not be created.
+     */
+    bool open(const std::string &path) {
+        if (path == "-") return true;
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(addr.sun_path)) return false;
+        strcpy(addr.sun_path, path.c_str());
+        unlink(path.c_str());
+        listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        in = out = -1;
+        return listen_fd >= 0 &&
+               bind(listen_fd, (sockaddr *)&addr, sizeof(addr)) == 0 &&
+               listen(listen_fd, 1) == 0;
+    }
+
+    /**
+     * Reads the next non-empty line. On a socket, waits for the next client
+     * when the current one disconnects.
+     *
+     * @param line Set to the line, without the newline.
+     * @return false at the end of stdin or on a socket error.
+     */
+    bool next_line(std::string &line) {
+        while (true) {
+            auto nl = buffer.find('\n');
+            if (nl != std::string::npos) {
+                line = buffer.substr(0, nl);
+                buffer.erase(0, nl + 1);
+                if (line.find_first_not_of(" \t\r") != std::string::npos)
+                    return true;
+                continue;
+            }
+            if (in < 0) {
+                in = out = accept(listen_fd, nullptr, nullptr);
+                if (in < 0) return false;
+            }
+            char chunk[4096];
+            ssize_t n = read(in, chunk, sizeof(chunk));
+            if (n > 0) {
+                buffer.append(chunk, n);
+                continue;
+            }
+            if (listen_fd < 0) {
+                // The last line of stdin may lack its newline.
+                line.swap(buffer);
+                buffer.clear();
+                return line.find_first_not_of(" \t\r") != std::string::npos;
+            }
+            close(in);
+            in = out = -1;
+            buffer.clear();
+        }
+    }
+
+    /**
+     * @brief Writes a line to the current client.
+     */
+    void reply(const std::string &line) {
+        std::string text = line + "\n";
+        for (size_t done = 0; out >= 0 && done < text.size();) {
+            const char *p = text.data() + done;
+            size_t left = text.size() - done;
+            // A client that hung up must not kill the server with SIGPIPE.
+            ssize_t n = listen_fd < 0 ? write(out, p, left)
+                                      : send(out, p, left, MSG_NOSIGNAL);
+            if (n <= 0) break;
+            done += n;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,170 @@
+#ifndef SORT_FIRST_IMPORT
+#define SORT_FIRST_IMPORT 1
+
+#include <mpi.h>
+
+#include "generate_image.hpp"
+#include "trace.hpp"
+
+/**
+ * @brief Splits the image rows into one horizontal band per rank for the
+ * sort-first decomposition.
+ */
+struct ScreenPartition {
+    int w, h, size;
+
+    ScreenPartition(const Camera &cam, int size)
+        : w(cam.image_size_x), h(cam.image_size_y), size(size) {}
+
+    /**
+     * @brief First row of the band owned by a rank.
+     */
+    int start(int rank) const { return (long)rank * h / size; }
+
+    /**
+     * @brief Number of rows in the band owned by a rank.
+     */
+    int rows(int rank) const { return start(rank + 1) - start(rank); }
+
+    /**
+     * @brief Rank owning the band that contains row y.
+     */
+    int rank_of(int y) const { return ((long)(y + 1) * size - 1) / h; }
+};
+
+/**
+ * @brief Buffers of exchange_splats and gather_bands, kept between frames
+ * so that their storage is reused.
+ */
+struct ExchangeScratch {
+    vector<vector<int>> buckets;  ///< Local splats sent to each rank
+    vector<int> order;            ///< Local splats grouped by destination
+    vector<int> send_counts, send_displs;  ///< Splats sent to each rank
+    vector<int> recv_counts, recv_displs;  ///< Splats received from each
+    vector<int> sc, sd, rc, rd;   ///< Byte counts and offsets of one column
+    vector<std::byte> send;       ///< One column packed in send order
+    vector<v4_t> band, frame;     ///< RGBA pixels of the gathered bands
+};
+
+/**
+ * Redistributes one column of per-splat data with MPI_Alltoallv.
+ *
+ * @param column The column to send from.
+ * @param recv The column receiving the elements, of the same type.
+ * @param scratch Holds the local indices to send, grouped by destination
+ *        rank, and the element counts and offsets per rank.
+ * @param comm The communicator.
+ */
+void exchange_column(const RawColumn &column, const RawColumn &recv,
+                     ExchangeScratch &scratch, MPI_Comm comm) {
+    auto &order = scratch.order;
+    size_t size = scratch.send_counts.size(), es = column.elem_size;
+    auto &send = scratch.send;
+    send.resize(order.size() * es);
+    for (size_t i = 0; i < order.size(); i++)
+        std::copy_n(column.data + order[i] * es, es, &send[i * es]);
+    auto &sc = scratch.sc, &sd = scratch.sd, &rc = scratch.rc,
+         &rd = scratch.rd;
+    sc.resize(size), sd.resize(size), rc.resize(size), rd.resize(size);
+    for (size_t r = 0; r < size; r++) {
+        sc[r] = scratch.send_counts[r] * es;
+        sd[r] = scratch.send_displs[r] * es;
+        rc[r] = scratch.recv_counts[r] * es;
+        rd[r] = scratch.recv_displs[r] * es;
+    }
+    MPI_Alltoallv(send.data(), sc.data(), sd.data(), MPI_BYTE, recv.data,
+                  rc.data(), rd.data(), MPI_BYTE, comm);
+}
+
+/**
+ * Sends every splat to all ranks whose screen band its footprint overlaps.
+ *
+ * Splats that are behind the camera or entirely off screen are dropped. The
+ * columns of the splat data are exchanged one by one as raw bytes with
+ * MPI_Alltoallv.
+ *
+ * @param data The splats loaded by this rank, replaced by the splats
+ *        overlapping this rank's band.
+ * @param recv Receives the splats; swapped with data at the end so that its
+ *        arena can be reused for the next frame.
+ * @param cam The full-resolution camera.
+ * @param part The screen partition.
+ * @param comm The communicator.
+ * @param scratch The exchange buffers.
+ */
+void exchange_splats(GaussianData &data, GaussianData &recv,
+                     const Camera &cam, const ScreenPartition &part,
+                     MPI_Comm comm, ExchangeScratch &scratch) {
+    TRACE_SCOPE("exchange_splats");
+    auto &buckets = scratch.buckets;
+    buckets.resize(part.size);
+    for (auto &b : buckets) b.clear();
+    for (size_t di = 0; di < data.size(); di++) {
+        auto d = PlotData(cam, cam.r_mat4.mat_mul(data.position(di)),
+                          data.covariance(di));
+        if (d.behind) continue;
+        int start_x = max(0, (int)round(d.x_c - d.x_r));
+        int start_y = max(0, (int)round(d.y_c - d.y_r));
+        int end_x = min(cam.image_size_x, (int)round(d.x_c + d.x_r) + 1);
+        int end_y = min(cam.image_size_y, (int)round(d.y_c + d.y_r) + 1);
+        if (start_x >= end_x || start_y >= end_y) continue;
+        for (int r = part.rank_of(start_y); r <= part.rank_of(end_y - 1); r++)
+            buckets[r].push_back(di);
+    }
+
+    auto &send_counts = scratch.send_counts;
+    auto &recv_counts = scratch.recv_counts;
+    send_counts.resize(part.size), recv_counts.resize(part.size);
+    for (int r = 0; r < part.size; r++) send_counts[r] = buckets[r].size();
+    MPI_Alltoall(send_counts.data(), 1, MPI_INT, recv_counts.data(), 1,
+                 MPI_INT, comm);
+
+    auto &order = scratch.order;
+    auto &send_displs = scratch.send_displs;
+    auto &recv_displs = scratch.recv_displs;
+    order.clear();
+    send_displs.resize(part.size), recv_displs.assign(part.size, 0);
+    for (int r = 0; r < part.size; r++) {
+        send_displs[r] = order.size();
+        order.insert(order.end(), buckets[r].begin(), buckets[r].end());
+    }
+    for (int r = 1; r < part.size; r++)
+        recv_displs[r] = recv_displs[r - 1] + recv_counts[r - 1];
+
+    recv.allocate(recv_displs.back() + recv_counts.back());
+    auto columns = data.raw_columns(), recv_columns = recv.raw_columns();
+    for (size_t c = 0; c < columns.size(); c++)
+        exchange_column(columns[c], recv_columns[c], scratch, comm);
+    std::swap(data, recv);
+}
+
+/**
+ * Gathers the bands rendered by every rank into the full image on the root.
+ *
+ * @param band The band rendered by this rank.
+ * @param image The full image, filled in on the root.
+ * @param part The screen partition.
+ * @param comm The communicator.
+ * @param scratch The pixel and count buffers.
+ * @param root The rank receiving the image.
+ */
+void gather_bands(const Image &band, Image &image, const ScreenPartition &part,
+                  MPI_Comm comm, ExchangeScratch &scratch, int root = 0) {
+    TRACE_SCOPE("gather_bands");
+    auto &send = scratch.band, &recv = scratch.frame;
+    band.to_rgba(send);
+    auto &counts = scratch.rc, &displs = scratch.rd;
+    counts.resize(part.size), displs.resize(part.size);
+    for (int r = 0; r < part.size; r++) {
+        counts[r] = part.rows(r) * part.w * sizeof(v4_t);
+        displs[r] = part.start(r) * part.w * sizeof(v4_t);
+    }
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+    if (rank == root) recv.resize(part.w * part.h);
+    MPI_Gatherv(send.data(), send.size() * sizeof(v4_t), MPI_BYTE, recv.data(),
+                counts.data(), displs.data(), MPI_BYTE, root, comm);
+    if (rank == root) image.from_rgba(recv);
+}
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef SPLAT_RANDOM_IMPORT
+#define SPLAT_RANDOM_IMPORT 1
+
+#include <cmath>
+#include <cstdint>
+
+/**
+ * @brief Counter-based random numbers: a SplitMix64 stream per splat.
+ *
+ * All streams step through the same cycle of 2^64 states, so the start of
+ * each one is the mixed seed and index. Starting from the raw index would
+ * put the streams of neighbouring splats a few steps apart, so that one
+ * splat's draws would repeat those of the next.
+ */
+struct SplatRandom {
+    static constexpr uint64_t gamma = 0x9e3779b97f4a7c15ull;
+    uint64_t state;
+
+    /**
+     * @param seed The seed of the scene.
+     * @param index The index of the splat.
+     */
+    SplatRandom(uint64_t seed, uint64_t index)
+        : state(mix(seed ^ mix(index + gamma))) {}
+
+    /**
+     * @brief The SplitMix64 output function, a bijection on 64 bits.
+     */
+    static uint64_t mix(uint64_t z) {
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+
+    uint64_t next() { return mix(state += gamma); }
+
+    /**
+     * @brief Uniform in [0, 1).
+     */
+    double uniform() { return (next() >> 11) * 0x1.0p-53; }
+
+    /**
+     * @brief Uniform in [lo, hi).
+     */
+    double uniform(double lo, double hi) { return lo + (hi - lo) * uniform(); }
+
+    /**
+     * @brief Normally distributed, by the Box-Muller transform.
+     */
+    double normal(double mean, double sd) {
+        double u = 1 - uniform(), v = uniform();
+        return mean + sd * std::sqrt(-2 * std::log(u)) * std::cos(2 * M_PI * v);
+    }
+};
+
+#endif
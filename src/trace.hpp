@@ -0,0 +1,252 @@
+#ifndef TRACE_IMPORT
+#define TRACE_IMPORT 1
+
+#include <mpi.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/*
+ * Timeline tracing, compiled in with -DTRACE. Every thread records its
+ * events into a ring buffer of its own, so recording takes no lock. At exit
+ * the events of all ranks are gathered on rank 0 and written as Chrome
+ * trace JSON, for chrome://tracing or ui.perfetto.dev, with one process per
+ * rank and one track per thread. Without -DTRACE the macros expand to
+ * nothing.
+ */
+
+/// The clock of the phase timers, so their time points can be traced.
+using TraceClock = std::chrono::high_resolution_clock;
+
+/**
+ * @brief One timed event.
+ */
+struct TraceEvent {
+    const char *name;  ///< A string literal
+    TraceClock::time_point begin, end;
+};
+
+/**
+ * @brief Ring buffer of the events of one thread. Only the owning thread
+ * writes to it; when full, the oldest events are overwritten.
+ */
+struct TraceBuffer {
+    std::vector<TraceEvent> events;
+    std::atomic<size_t> head{0};  ///< Events recorded so far
+    int thread;                   ///< Index of the thread on its rank
+
+    TraceBuffer(size_t capacity, int thread_)
+        : events(capacity), thread(thread_) {}
+
+    void push(const TraceEvent &event) {
+        size_t h = head.load(std::memory_order_relaxed);
+        events[h % events.size()] = event;
+        head.store(h + 1, std::memory_order_release);
+    }
+};
+
+/**
+ * @brief Nanoseconds since the epoch of the trace clock.
+ */
+inline int64_t trace_ns(TraceClock::time_point t) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               t.time_since_epoch())
+        .count();
+}
+
+/**
+ * @brief The event buffers of all threads of this rank.
+ */
+struct Tracer {
+    static constexpr size_t capacity = 1 << 16;  ///< Events per thread
+
+    std::mutex mutex;  ///< Guards buffers, taken once per thread
+    std::vector<std::unique_ptr<TraceBuffer>> buffers;
+
+    static Tracer &instance() {
+        static Tracer tracer;
+        return tracer;
+    }
+
+    /**
+     * @brief Returns the buffer of the calling thread, creating it on the
+     * first call.
+     */
+    TraceBuffer &local() {
+        thread_local TraceBuffer *buffer = nullptr;
+        if (!buffer) {
+            std::lock_guard<std::mutex> lock(mutex);
+            buffers.push_back(
+                std::make_unique<TraceBuffer>(capacity, buffers.size()));
+            buffer = buffers.back().get();
+        }
+        return *buffer;
+    }
+
+    void record(const char *name, TraceClock::time_point begin,
+                TraceClock::time_point end) {
+        local().push({name, begin, end});
+    }
+
+    /**
+     * Estimates the offset of the clock of this rank to that of rank 0.
+     *
+     * After a barrier every rank in turn does a few round trips with
+     * rank 0, which replies with its clock. The round trip with the
+     * shortest time is used, assuming the reply was read halfway through
+     * it. Collective over comm.
+     *
+     * @param comm The communicator of the ranks.
+     * @return Nanoseconds to add to a time of this rank to get the time of
+     *         rank 0.
+     */
+    static int64_t clock_offset(MPI_Comm comm) {
+        const int rounds = 16;
+        int rank, size;
+        MPI_Comm_rank(comm, &rank);
+        MPI_Comm_size(comm, &size);
+        MPI_Barrier(comm);
+        int64_t offset = 0, best = INT64_MAX;
+        for (int r = 1; r < size; r++) {
+            for (int i = 0; i < rounds; i++) {
+                if (rank == 0) {
+                    MPI_Recv(nullptr, 0, MPI_BYTE, r, 0, comm,
+                             MPI_STATUS_IGNORE);
+                    int64_t now = trace_ns(TraceClock::now());
+                    MPI_Send(&now, 1, MPI_INT64_T, r, 0, comm);
+                } else if (rank == r) {
+                    int64_t remote, sent = trace_ns(TraceClock::now());
+                    MPI_Send(nullptr, 0, MPI_BYTE, 0, 0, comm);
+                    MPI_Recv(&remote, 1, MPI_INT64_T, 0, 0, comm,
+                             MPI_STATUS_IGNORE);
+                    int64_t received = trace_ns(TraceClock::now());
+                    if (received - sent < best) {
+                        best = received - sent;
+                        offset = remote - (sent + received) / 2;
+                    }
+                }
+            }
+        }
+        return offset;
+    }
+
+    /**
+     * Gathers the events of all ranks and writes them on rank 0.
+     * Collective over comm; the other threads must not be recording.
+     *
+     * @param path The Chrome trace JSON file.
+     * @param comm The communicator of the ranks, whose ranks become the
+     *        process ids of the trace.
+     */
+    void write(const std::string &path, MPI_Comm comm) {
+        int rank, size;
+        MPI_Comm_rank(comm, &rank);
+        MPI_Comm_size(comm, &size);
+        int64_t offset = clock_offset(comm);
+
+        // Times are relative to the first event of any rank.
+        int64_t first = INT64_MAX, origin;
+        for (auto &b : buffers) {
+            size_t head = b->head.load(std::memory_order_acquire);
+            for (size_t i = head - std::min(head, capacity); i < head; i++)
+                first = std::min(first,
+                                 trace_ns(b->events[i % capacity].begin));
+        }
+        if (first != INT64_MAX) first += offset;
+        MPI_Allreduce(&first, &origin, 1, MPI_INT64_T, MPI_MIN, comm);
+
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(3);
+        out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << rank
+            << ",\"args\":{\"name\":\"rank " << rank << "\"}},\n"
+            << "{\"name\":\"process_sort_index\",\"ph\":\"M\",\"pid\":"
+            << rank << ",\"args\":{\"sort_index\":" << rank << "}},\n";
+        for (auto &b : buffers) {
+            size_t head = b->head.load(std::memory_order_acquire);
+            size_t kept = std::min(head, capacity);
+            out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << rank
+                << ",\"tid\":" << b->thread << ",\"args\":{\"name\":\"thread "
+                << b->thread << "\",\"dropped\":" << head - kept << "}},\n";
+            for (size_t i = head - kept; i < head; i++) {
+                auto &e = b->events[i % capacity];
+                out << "{\"name\":\"" << e.name << "\",\"ph\":\"X\",\"pid\":"
+                    << rank << ",\"tid\":" << b->thread << ",\"ts\":"
+                    << (trace_ns(e.begin) + offset - origin) / 1e3
+                    << ",\"dur\":"
+                    << (trace_ns(e.end) - trace_ns(e.begin)) / 1e3 << "},\n";
+            }
+        }
+
+        std::string text = out.str();
+        int length = text.size();
+        std::vector<int> lengths(size), displs(size);
+        MPI_Gather(&length, 1, MPI_INT, lengths.data(), 1, MPI_INT, 0, comm);
+        std::string all;
+        if (rank == 0) {
+            for (int r = 1; r < size; r++)
+                displs[r] = displs[r - 1] + lengths[r - 1];
+            all.resize(displs[size - 1] + lengths[size - 1]);
+        }
+        MPI_Gatherv(text.data(), length, MPI_CHAR, all.data(), lengths.data(),
+                    displs.data(), MPI_CHAR, 0, comm);
+        if (rank != 0) return;
+        all.resize(all.size() - 2);  // The last ",\n"
+        std::ofstream file(path);
+        file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+             << all << "\n]}\n";
+    }
+};
+
+/**
+ * @brief Records an event from its construction to its destruction.
+ */
+struct TraceScope {
+    const char *name;
+    TraceClock::time_point begin = TraceClock::now();
+
+    explicit TraceScope(const char *name_) : name(name_) {}
+    ~TraceScope() {
+        Tracer::instance().record(name, begin, TraceClock::now());
+    }
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+#ifdef TRACE
+/// Traces the rest of the enclosing scope; name must be a string literal.
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+/// Traces an event between two TraceClock time points.
+#define TRACE_SPAN(name, t1, t2) Tracer::instance().record(name, t1, t2)
+#else
+#define TRACE_SCOPE(name)
+#define TRACE_SPAN(name, t1, t2)
+#endif
+
+/**
+ * Writes the trace of all ranks. Collective over comm.
+ *
+ * @param path The Chrome trace JSON file.
+ * @param comm The communicator of the ranks.
+ * @return false if tracing was not compiled in.
+ */
+inline bool write_trace(const std::string &path, MPI_Comm comm) {
+#ifdef TRACE
+    Tracer::instance().write(path, comm);
+    return true;
+#else
+    (void)path, (void)comm;
+    return false;
+#endif
+}
+
+#endif
@@ -1,7 +1,13 @@
+#ifndef TRANSPOSE_SORT_IMPORT
+#define TRANSPOSE_SORT_IMPORT 1
+
 #include <mpi.h>
 
+#include <algorithm>
 #include <vector>
 
+#include "trace.hpp"
+
 /**
  * @brief A template struct representing a sorting engine for parallel sorting using MPI.
  * 
@@ -11,6 +17,7 @@ template <typename T>
 struct SortEngine {
     std::vector<T> mydata, odata, tmp; // Input, output, and temporary vectors
     int world_rank, world_size, count; // MPI rank, size, and count
+    MPI_Comm comm; // Communicator of world_rank and world_size
 
     /**
      * @brief Constructs a SortEngine object.
@@ -18,13 +25,35 @@ struct SortEngine {
      * @param mydata_ The input data to be sorted.
      * @param world_rank_ The rank of the current MPI process.
      * @param world_size_ The total number of MPI processes.
+     * @param comm_ The communicator of the processes.
      */
-    SortEngine(std::vector<T> mydata_, int world_rank_, int world_size_)
-        : odata(mydata_.size()),
-          tmp(mydata_.size()),
-          world_rank(world_rank_),
-          world_size(world_size_) {
+    SortEngine(std::vector<T> mydata_, int world_rank_, int world_size_,
+               MPI_Comm comm_ = MPI_COMM_WORLD)
+        : world_rank(world_rank_), world_size(world_size_), comm(comm_) {
         mydata = std::move(mydata_);
+        prepare();
+    }
+
+    /**
+     * @brief Constructs an empty SortEngine that is filled through mydata and
+     * reused for several sorts.
+     * 
+     * @param world_rank_ The rank of the current MPI process.
+     * @param world_size_ The total number of MPI processes.
+     * @param comm_ The communicator of the processes.
+     */
+    SortEngine(int world_rank_, int world_size_,
+               MPI_Comm comm_ = MPI_COMM_WORLD)
+        : world_rank(world_rank_), world_size(world_size_), count(0),
+          comm(comm_) {}
+
+    /**
+     * @brief Sizes the exchange buffers for the current contents of mydata,
+     * reusing their storage from earlier sorts.
+     */
+    void prepare() {
+        odata.resize(mydata.size());
+        tmp.resize(mydata.size());
         count = mydata.size() * sizeof(T);
     }
 
@@ -34,7 +63,7 @@ struct SortEngine {
      * @param orank The rank of the destination MPI process.
      */
     void send(int orank) {
-        MPI_Send(mydata.data(), count, MPI_BYTE, orank, 0, MPI_COMM_WORLD);
+        MPI_Send(mydata.data(), count, MPI_BYTE, orank, 0, comm);
     }
 
     /**
@@ -44,7 +73,7 @@ struct SortEngine {
      */
     void recv(int orank) {
         MPI_Status status;
-        MPI_Recv(odata.data(), count, MPI_BYTE, orank, 0, MPI_COMM_WORLD, &status);
+        MPI_Recv(odata.data(), count, MPI_BYTE, orank, 0, comm, &status);
     }
 
     /**
@@ -53,6 +82,7 @@ struct SortEngine {
      * @param orank The rank of the other MPI process.
      */
     void exchange_data(int orank) {
+        TRACE_SCOPE("SortEngine::exchange_data");
         if (orank > world_rank) send(orank);
         recv(orank);
         if (orank < world_rank) send(orank);
@@ -105,4 +135,6 @@ struct SortEngine {
             step_sort(step);
         }
     }
-};
\ No newline at end of file
+};
+
+#endif
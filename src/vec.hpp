@@ -5,7 +5,9 @@
 
 #include <array>
 #include <cassert>
+#include <functional>
 #include <ostream>
+#include <type_traits>
 #include <vector>
 
 using std::array;
@@ -70,7 +72,9 @@ struct vec : public array<el_T, C> {
      * 
      * @return A new vector with the same direction as the original vector, but with unit length.
      */
-    auto normalized() const { return (*this) / sqrt((*this).squared().sum()); }
+    vec<el_T, C> normalized() const {
+        return (*this) / sqrt((*this).squared().sum());
+    }
 
     /**
      * @brief Resizes the vector to a new size.
@@ -190,6 +194,37 @@ struct mat : public array<vec<el_T, C>, R> {
     }
 };
 
+/**
+ * @brief A symmetric 3x3 matrix that stores only its six unique elements,
+ * in the order xx, xy, xz, yy, yz, zz.
+ *
+ * @tparam el_T The element type of the matrix.
+ */
+template <typename el_T>
+struct sym3 : public array<el_T, 6> {
+    /**
+     * @brief Expands to a full 3x3 matrix.
+     */
+    auto full() const {
+        const auto& s = *this;
+        // clang-format off
+        return mat<el_T, 3, 3>{s[0], s[1], s[2],
+                               s[1], s[3], s[4],
+                               s[2], s[4], s[5]};
+        // clang-format on
+    }
+
+    /**
+     * @brief Multiplies the matrix with a vector.
+     */
+    vec<el_T, 3> mat_mul(const vec<el_T, 3>& v) const {
+        const auto& s = *this;
+        return vec<el_T, 3>{s[0] * v[0] + s[1] * v[1] + s[2] * v[2],
+                            s[1] * v[0] + s[3] * v[1] + s[4] * v[2],
+                            s[2] * v[0] + s[4] * v[1] + s[5] * v[2]};
+    }
+};
+
 template <typename el_T, size_t CA>
 /**
  * Computes the diagonal matrix from a given vector.
@@ -203,45 +238,147 @@ auto diag(vec<el_T, CA> A) {
     return O;
 }
 
-#define IMPL_fun(fun)                                        \
-    template <typename el_T, size_t CA>                      \
-    auto fun(const vec<el_T, CA>& A) {                       \
-        vec<el_T, CA> O;                                     \
-        for (size_t i = 0; i < CA; i++) O[i] = fun(A[i]);       \
-        return O;                                            \
-    }                                                        \
-    template <typename el_T, size_t RA, size_t CA>           \
-    auto fun(const mat<el_T, RA, CA>& A) {                   \
-        mat<el_T, RA, CA> O;                                 \
-        for (size_t i = 0; i < CA; i++) O[i] = fun(A[i]);       \
-        return O;                                            \
-    }                                                        \
-    template <typename TA, size_t NA>                        \
-    auto fun(const array<TA, NA>& A) {                       \
-        array<TA, NA> O;                                     \
-        for (size_t i = 0; i < NA; i++) O[i] = fun(A[i]);       \
-        return O;                                            \
-    }                                                        \
-    template <typename TA>                                   \
-    auto fun(const vector<TA>& A) {                          \
-        vector<TA> O(A.size());                              \
-        for (size_t i = 0; i < A.size(); i++) O[i] = fun(A[i]); \
-        return O;                                            \
+/**
+ * @brief Tag shared by all vector expression nodes.
+ */
+struct vec_expr_tag {};
+
+/**
+ * @brief Base of the lazy element-wise vector expressions.
+ *
+ * The arithmetic operators and sqrt, exp, log and abs on vectors return
+ * expression nodes instead of vectors. A tree of nodes is only evaluated,
+ * in a single loop over the elements, when it is converted to a vec, which
+ * normally happens on assignment. Vectors that are lvalues are held by
+ * reference, everything else by value, so an expression may be stored with
+ * auto as long as the named vectors in it outlive it.
+ *
+ * @tparam E The derived node type, providing operator[].
+ * @tparam el_T The element type.
+ * @tparam C The size of the vector.
+ */
+template <typename E, typename el_T, size_t C>
+struct vec_expr : vec_expr_tag {
+    using value_type = el_T;
+    static constexpr size_t extent = C;
+
+    static constexpr size_t size() { return C; }
+
+    constexpr el_T at(size_t i) const {
+        return static_cast<const E&>(*this)[i];
     }
 
-using std::abs;
-using std::exp;
-using std::log;
-using std::sqrt;
-IMPL_fun(sqrt) IMPL_fun(exp) IMPL_fun(log) IMPL_fun(abs);
+    /**
+     * @brief Evaluates the expression into a vector.
+     */
+    constexpr vec<el_T, C> eval() const {
+        vec<el_T, C> O;
+        for (size_t i = 0; i < C; i++) O[i] = at(i);
+        return O;
+    }
 
-#define IMPL_ops(op)                                                           \
-    template <typename el_T, size_t CA, size_t CB>                             \
-    auto operator op(const vec<el_T, CA>& A, const vec<el_T, CB>& B) {         \
-        static_assert(CA == CB, "Wrong dimensions");                           \
-        vec<el_T, CA> O;                                                       \
-        for (size_t i = 0; i < CA; i++) O[i] = A[i] op B[i];                      \
-        return O;                                                              \
+    constexpr operator vec<el_T, C>() const { return eval(); }
+
+    constexpr el_T sum() const {
+        el_T ret = 0;
+        for (size_t i = 0; i < C; i++) ret += at(i);
+        return ret;
+    }
+
+    template <size_t CB>
+    auto dot(const vec<el_T, CB>& B) const {
+        return eval().dot(B);
+    }
+    auto squared() const { return eval().squared(); }
+    auto norm2() const { return eval().norm2(); }
+    auto normalized() const { return eval().normalized(); }
+};
+
+/**
+ * @brief Element type and size of the operands of vector expressions.
+ */
+template <typename T>
+struct vec_operand_traits : std::false_type {};
+
+template <typename el_T, size_t C>
+struct vec_operand_traits<vec<el_T, C>> : std::true_type {
+    using el_type = el_T;
+    static constexpr size_t size = C;
+};
+
+template <typename T>
+    requires std::is_base_of_v<vec_expr_tag, T>
+struct vec_operand_traits<T> : std::true_type {
+    using el_type = typename T::value_type;
+    static constexpr size_t size = T::extent;
+};
+
+template <typename T>
+concept vec_operand = vec_operand_traits<std::remove_cvref_t<T>>::value;
+
+template <typename T>
+using vec_el_t = typename vec_operand_traits<std::remove_cvref_t<T>>::el_type;
+
+/**
+ * @brief How an operand is held by an expression node: named vectors by
+ * reference, temporaries and other nodes by value.
+ */
+template <typename T>
+using vec_held_t =
+    std::conditional_t<std::is_lvalue_reference_v<T> &&
+                           !std::is_base_of_v<vec_expr_tag,
+                                              std::remove_cvref_t<T>>,
+                       const std::remove_cvref_t<T>&, std::remove_cvref_t<T>>;
+
+/**
+ * @brief A scalar broadcast to every element of a vector expression.
+ */
+template <typename el_T>
+struct vec_scalar {
+    el_T v;
+    constexpr el_T operator[](size_t) const { return v; }
+};
+
+/**
+ * @brief An element-wise binary operation of two operands.
+ */
+template <typename Op, typename L, typename R, typename el_T, size_t C>
+struct vec_binary : vec_expr<vec_binary<Op, L, R, el_T, C>, el_T, C> {
+    L l;
+    R r;
+    constexpr vec_binary(L l_, R r_) : l(l_), r(r_) {}
+    constexpr el_T operator[](size_t i) const { return Op{}(l[i], r[i]); }
+};
+
+#define IMPL_ops(op, Op)                                                       \
+    template <typename A, typename B>                                          \
+        requires vec_operand<A> && vec_operand<B>                              \
+    constexpr auto operator op(A&& a, B&& b) {                                 \
+        using TA = vec_operand_traits<std::remove_cvref_t<A>>;                 \
+        using TB = vec_operand_traits<std::remove_cvref_t<B>>;                 \
+        static_assert(TA::size == TB::size, "Wrong dimensions");               \
+        static_assert(std::is_same_v<typename TA::el_type,                     \
+                                     typename TB::el_type>,                    \
+                      "Wrong element types");                                  \
+        return vec_binary<Op, vec_held_t<A>, vec_held_t<B>,                    \
+                          typename TA::el_type, TA::size>(                     \
+            std::forward<A>(a), std::forward<B>(b));                           \
+    }                                                                          \
+    template <typename A>                                                      \
+        requires vec_operand<A>                                                \
+    constexpr auto operator op(A&& a, vec_el_t<A> b) {                         \
+        using TA = vec_operand_traits<std::remove_cvref_t<A>>;                 \
+        using S = vec_scalar<typename TA::el_type>;                            \
+        return vec_binary<Op, vec_held_t<A>, S, typename TA::el_type,          \
+                          TA::size>(std::forward<A>(a), S{b});                 \
+    }                                                                          \
+    template <typename B>                                                      \
+        requires vec_operand<B>                                                \
+    constexpr auto operator op(vec_el_t<B> a, B&& b) {                         \
+        using TB = vec_operand_traits<std::remove_cvref_t<B>>;                 \
+        using S = vec_scalar<typename TB::el_type>;                            \
+        return vec_binary<Op, S, vec_held_t<B>, typename TB::el_type,          \
+                          TB::size>(S{a}, std::forward<B>(b));                 \
     }                                                                          \
     template <typename el_T, size_t RA, size_t CA, size_t RB, size_t CB>       \
     auto operator op(const mat<el_T, RA, CA>& A, const mat<el_T, RB, CB>& B) { \
@@ -250,18 +387,6 @@ IMPL_fun(sqrt) IMPL_fun(exp) IMPL_fun(log) IMPL_fun(abs);
         for (size_t i = 0; i < CA; i++) O[i] = A[i] op B[i];                      \
         return O;                                                              \
     }                                                                          \
-    template <typename el_T, size_t CA>                                        \
-    auto operator op(const vec<el_T, CA>& A, el_T b) {                         \
-        vec<el_T, CA> O;                                                       \
-        for (size_t i = 0; i < CA; i++) O[i] = A[i] op b;                         \
-        return O;                                                              \
-    }                                                                          \
-    template <typename el_T, size_t CA>                                        \
-    auto operator op(el_T a, const vec<el_T, CA>& B) {                         \
-        vec<el_T, CA> O;                                                       \
-        for (size_t i = 0; i < CA; i++) O[i] = a op B[i];                         \
-        return O;                                                              \
-    }                                                                          \
     template <typename el_T, size_t RA, size_t CA>                             \
     auto operator op(const mat<el_T, RA, CA>& A, el_T b) {                     \
         mat<el_T, RA, CA> O;                                                   \
@@ -275,7 +400,58 @@ IMPL_fun(sqrt) IMPL_fun(exp) IMPL_fun(log) IMPL_fun(abs);
         return O;                                                              \
     }
 
-IMPL_ops(+) IMPL_ops(*) IMPL_ops(/) IMPL_ops(-);
+IMPL_ops(+, std::plus<>) IMPL_ops(*, std::multiplies<>);
+IMPL_ops(/, std::divides<>) IMPL_ops(-, std::minus<>);
+
+/**
+ * @brief An element-wise function of one operand.
+ */
+template <typename Fun, typename A, typename el_T, size_t C>
+struct vec_unary : vec_expr<vec_unary<Fun, A, el_T, C>, el_T, C> {
+    A a;
+    constexpr vec_unary(A a_) : a(a_) {}
+    constexpr el_T operator[](size_t i) const { return Fun{}(a[i]); }
+};
+
+#define IMPL_fun(fun)                                                    \
+    struct vec_fun_##fun {                                               \
+        template <typename T>                                            \
+        auto operator()(T x) const {                                     \
+            return fun(x);                                               \
+        }                                                                \
+    };                                                                   \
+    template <typename A>                                                \
+        requires vec_operand<A>                                          \
+    auto fun(A&& a) {                                                    \
+        using TA = vec_operand_traits<std::remove_cvref_t<A>>;           \
+        return vec_unary<vec_fun_##fun, vec_held_t<A>,                   \
+                         typename TA::el_type, TA::size>(                \
+            std::forward<A>(a));                                         \
+    }                                                                    \
+    template <typename el_T, size_t RA, size_t CA>                       \
+    auto fun(const mat<el_T, RA, CA>& A) {                               \
+        mat<el_T, RA, CA> O;                                             \
+        for (size_t i = 0; i < CA; i++) O[i] = fun(A[i]);                \
+        return O;                                                        \
+    }                                                                    \
+    template <typename TA, size_t NA>                                    \
+    auto fun(const array<TA, NA>& A) {                                   \
+        array<TA, NA> O;                                                 \
+        for (size_t i = 0; i < NA; i++) O[i] = fun(A[i]);                \
+        return O;                                                        \
+    }                                                                    \
+    template <typename TA>                                               \
+    auto fun(const vector<TA>& A) {                                      \
+        vector<TA> O(A.size());                                          \
+        for (size_t i = 0; i < A.size(); i++) O[i] = fun(A[i]);          \
+        return O;                                                        \
+    }
+
+using std::abs;
+using std::exp;
+using std::log;
+using std::sqrt;
+IMPL_fun(sqrt) IMPL_fun(exp) IMPL_fun(log) IMPL_fun(abs);
 
 template <typename el_T, size_t C>
 std::ostream& operator<<(std::ostream& os, const vec<el_T, C>& m) {
@@ -359,4 +535,6 @@ auto broadcast_to(TA A, TB B, array<TO, NO> O, _Function __f) {
     }
 }
 
+#include "vec_simd.hpp"
+
 #endif
\ No newline at end of file
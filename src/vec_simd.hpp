@@ -0,0 +1,75 @@
+#ifndef VEC_SIMD_IMPORT
+#define VEC_SIMD_IMPORT 1
+
+#include "vec.hpp"
+
+#if defined(__SSE__) && !defined(NO_SIMD)
+#include <xmmintrin.h>
+
+/*
+ * SSE versions of the 4x4 float matrix products.
+ *
+ * They are explicit specializations of the generic code in vec.hpp, so
+ * callers pick them up without changes. Element-wise vector arithmetic is
+ * left to the expression templates, whose fused loops the compiler
+ * vectorizes itself. The products are summed in the same order as the
+ * generic loops, so results are bit-identical. Define NO_SIMD to build with
+ * the generic code only.
+ */
+
+namespace simd {
+
+inline __m128 load(const vec<float, 4>& A) { return _mm_loadu_ps(A.data()); }
+
+inline vec<float, 4> store(__m128 a) {
+    vec<float, 4> O;
+    _mm_storeu_ps(O.data(), a);
+    return O;
+}
+
+/**
+ * @brief Loads the columns of a 4x4 matrix.
+ */
+inline void load_columns(const mat<float, 4, 4>& A, __m128 (&col)[4]) {
+    for (size_t i = 0; i < 4; i++) col[i] = load(A[i]);
+    _MM_TRANSPOSE4_PS(col[0], col[1], col[2], col[3]);
+}
+
+/**
+ * @brief Linear combination of four columns, summed left to right.
+ */
+inline __m128 combine(const __m128 (&col)[4], const float* w) {
+    __m128 acc = _mm_mul_ps(col[0], _mm_set1_ps(w[0]));
+    acc = _mm_add_ps(acc, _mm_mul_ps(col[1], _mm_set1_ps(w[1])));
+    acc = _mm_add_ps(acc, _mm_mul_ps(col[2], _mm_set1_ps(w[2])));
+    acc = _mm_add_ps(acc, _mm_mul_ps(col[3], _mm_set1_ps(w[3])));
+    return acc;
+}
+
+}  // namespace simd
+
+template <>
+template <>
+inline auto mat<float, 4, 4>::mat_mul<4>(const vec<float, 4>& B) const {
+    __m128 col[4];
+    simd::load_columns(*this, col);
+    return simd::store(simd::combine(col, B.data()));
+}
+
+template <>
+template <>
+inline auto mat<float, 4, 4>::mat_mul_T<4, 4>(
+    const mat<float, 4, 4>& B) const {
+    // Row i of A * B^T is the combination of the columns of B^T, that is
+    // the rows of B transposed, weighted by row i of A.
+    __m128 col[4];
+    simd::load_columns(B, col);
+    mat<float, 4, 4> O;
+    for (size_t i = 0; i < 4; i++)
+        O[i] = simd::store(simd::combine(col, (*this)[i].data()));
+    return O;
+}
+
+#endif
+
+#endif
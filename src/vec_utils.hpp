@@ -25,13 +25,22 @@ template <typename T>
 /**
  * Calculates the covariance matrix for a 3D point cloud.
  *
+ * Only the six unique elements of rot^T * diag(scale^2) * rot are computed.
+ *
  * @param scale The scaling factors along the x, y, and z axes.
  * @param rot The rotation matrix representing the orientation.
- * @return The covariance matrix.
+ * @return The symmetric covariance matrix.
  */
-mat<T, 3, 3> calc_cov3d(const vec<T, 3>& scale, const mat<T, 3, 3>& rot) {
-    auto rot_T = rot.T();
-    return rot_T.mat_mul_diag(scale.squared()).mat_mul_T(rot_T);
+sym3<T> calc_cov3d(const vec<T, 3>& scale, const mat<T, 3, 3>& rot) {
+    auto s2 = scale.squared();
+    sym3<T> cov;
+    size_t k = 0;
+    for (size_t i = 0; i < 3; i++)
+        for (size_t j = i; j < 3; j++)
+            cov[k++] = rot[0][i] * rot[0][j] * s2[0] +
+                       rot[1][i] * rot[1][j] * s2[1] +
+                       rot[2][i] * rot[2][j] * s2[2];
+    return cov;
 }
 
 struct PlotData {
@@ -43,28 +52,26 @@ struct PlotData {
      *
      * This constructor initializes a PlotData object with the given parameters.
      *
+     * The 2D covariance is the upper 2x2 block of T * cov3d * T^T with
+     * T = J * W. Only the first two rows of T contribute to it, and for the
+     * projection used here they are the first two rows of the camera
+     * rotation scaled by f / z, so just those three terms are computed.
+     *
      * @param camera The camera object used for plotting.
      * @param g_pos_cam The position of the object in camera coordinates.
-     * @param cov3d The 3x3 covariance matrix.
+     * @param cov3d The symmetric 3x3 covariance matrix.
      */
     PlotData(const Camera& camera, const vec<T, 4>& g_pos_cam,
-             const mat<T, 3, 3>& cov3d) {
-        const T limx = 1.3f * camera.htanx * g_pos_cam[2],
-                limy = 1.3f * camera.htany * g_pos_cam[2];
-        const T x = max(min(g_pos_cam[0], limx), -limx),
-                y = max(min(g_pos_cam[1], limy), -limy), z = g_pos_cam[2],
-                z2 = z * z;
-        const T fx = camera.f, fy = camera.f;
-        // clang-format off
-        mat<T, 3, 3> T_T = mat<T, 3, 3>
-        {fx/z      ,0          ,0,
-        0         ,fy/z       ,0,
-        -(fx*x)/z2, -(fy*y)/z2,0}.mat_mul_T(camera.r_mat3_T);
-        // clang-format on
-        const auto cov = T_T.mat_mul_T(cov3d).mat_mul_T(T_T);
+             const sym3<T>& cov3d) {
+        const T z = g_pos_cam[2];
+        const T sx = camera.f / z, sy = camera.f / z;
+        const auto &u = camera.r_mat3[0], &v = camera.r_mat3[1];
+        const auto cov_u = cov3d.mat_mul(u);
+        const T a = sx * sx * u.dot(cov_u), b = sx * sy * v.dot(cov_u),
+                c = sy * sy * v.dot(cov3d.mat_mul(v));
         // clang-format off
-        mat<T, 2, 2>cov2d {(T)0.3+cov[0][0],     cov[0][1],
-                                cov[1][0], (T)0.3+cov[1][1]};
+        mat<T, 2, 2>cov2d {(T)0.3+a,        b,
+                                  b, (T)0.3+c};
         // clang-format on
         const auto det_inv =
             1 / (cov2d[0][0] * cov2d[1][1] - cov2d[1][0] * cov2d[0][1]);
@@ -0,0 +1,241 @@
+#ifndef WORK_STEAL_IMPORT
+#define WORK_STEAL_IMPORT 1
+
+#include <mpi.h>
+
+#include "generate_image.hpp"
+#include "sort_first.hpp"
+#include "trace.hpp"
+
+/**
+ * @brief One tile counter per rank in an MPI window. Tiles are claimed with
+ * an atomic fetch-and-add, by the owner and by idle ranks alike.
+ */
+struct TileQueue {
+    MPI_Win win;
+    int *counter;
+
+    TileQueue(MPI_Comm comm) {
+        MPI_Win_allocate(sizeof(int), sizeof(int), MPI_INFO_NULL, comm,
+                         &counter, &win);
+        *counter = 0;
+        MPI_Barrier(comm);
+        MPI_Win_lock_all(0, win);
+    }
+
+    ~TileQueue() {
+        MPI_Win_unlock_all(win);
+        MPI_Win_free(&win);
+    }
+
+    TileQueue(const TileQueue &) = delete;
+    TileQueue &operator=(const TileQueue &) = delete;
+
+    /**
+     * @brief Claims the next tile of a rank.
+     *
+     * @param owner The rank owning the queue.
+     * @return The claimed tile, possibly past the last tile of the owner.
+     */
+    int claim(int owner) {
+        int one = 1, tile;
+        MPI_Fetch_and_op(&one, &tile, MPI_INT, owner, 0, MPI_SUM, win);
+        MPI_Win_flush(owner, win);
+        return tile;
+    }
+};
+
+/**
+ * @brief Exposes every rank's projected splats through an MPI window so that
+ * idle ranks can fetch them before stealing tiles.
+ */
+struct SplatWindow {
+    MPI_Win win;
+    vector<int> &counts;  ///< Number of splats exposed by each rank
+
+    SplatWindow(vector<ProjectedSplat> &splats, vector<int> &counts,
+                MPI_Comm comm)
+        : counts(counts) {
+        int size, count = splats.size();
+        MPI_Comm_size(comm, &size);
+        counts.resize(size);
+        MPI_Allgather(&count, 1, MPI_INT, counts.data(), 1, MPI_INT, comm);
+        MPI_Win_create(splats.data(), count * sizeof(ProjectedSplat), 1,
+                       MPI_INFO_NULL, comm, &win);
+        MPI_Win_lock_all(0, win);
+    }
+
+    ~SplatWindow() {
+        MPI_Win_unlock_all(win);
+        MPI_Win_free(&win);
+    }
+
+    SplatWindow(const SplatWindow &) = delete;
+    SplatWindow &operator=(const SplatWindow &) = delete;
+
+    /**
+     * @brief Copies all projected splats of a rank into splats.
+     */
+    void fetch(int owner, vector<ProjectedSplat> &splats) {
+        splats.resize(counts[owner]);
+        MPI_Get(splats.data(), splats.size() * sizeof(ProjectedSplat),
+                MPI_BYTE, owner, 0, splats.size() * sizeof(ProjectedSplat),
+                MPI_BYTE, win);
+        MPI_Win_flush(owner, win);
+    }
+};
+
+/**
+ * @brief A tile rendered by a rank other than the owner of its band.
+ */
+struct StolenTile {
+    int y0;       ///< First camera image row of the tile
+    Image image;  ///< The rendered rows
+};
+
+/**
+ * @brief Buffers of render_band_stealing and merge_stolen, kept between
+ * frames so that their storage is reused.
+ */
+struct StealScratch {
+    RenderScratch render;                 ///< Depth sort of the own splats
+    vector<ProjectedSplat> splats;        ///< Own projected splats
+    vector<ProjectedSplat> victim;        ///< Splats fetched from a victim
+    vector<int> counts;                   ///< Splats or tiles per rank
+    vector<StolenTile> stolen;            ///< Tile images, the first n_stolen
+    int n_stolen = 0;                     ///< Tiles rendered for other ranks
+    int tile_rows = 0;                    ///< Rows of a full tile
+    size_t drawn = 0;    ///< Splats blended per tile, own and stolen tiles
+    size_t blended = 0;  ///< Pixel updates in own and stolen tiles
+    vector<v4_t> rgba;                    ///< One tile in transit
+    Image tile;                           ///< One received tile
+};
+
+/**
+ * Renders the band of this rank in tiles of rows, then steals the remaining
+ * tiles of the other ranks.
+ *
+ * Every rank first drains its own queue, rendering into its band image.
+ * It then walks the other ranks, fetching their projected splats on the
+ * first successful claim, and renders the stolen tiles separately.
+ *
+ * @param band Reset to the band image, missing the tiles that were stolen
+ *        from it.
+ * @param cam The full-resolution camera.
+ * @param data The splats overlapping this rank's band.
+ * @param part The screen partition.
+ * @param tile_rows The number of rows in a tile.
+ * @param comm The communicator.
+ * @param scratch Filled with the tiles rendered for other ranks.
+ */
+void render_band_stealing(Image &band, const Camera &cam,
+                          const GaussianData &data,
+                          const ScreenPartition &part, int tile_rows,
+                          MPI_Comm comm, StealScratch &scratch) {
+    TRACE_SCOPE("render_band_stealing");
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+    auto &splats = scratch.splats;
+    project(cam, data, splats, scratch.render);
+    SplatWindow window(splats, scratch.counts, comm);
+    scratch.victim.reserve(
+        *std::max_element(scratch.counts.begin(), scratch.counts.end()));
+    TileQueue queue(comm);
+
+    auto n_tiles = [&](int r) {
+        return (part.rows(r) + tile_rows - 1) / tile_rows;
+    };
+    auto tile_start = [&](int r, int t) {
+        return part.start(r) + t * tile_rows;
+    };
+    auto tile_end = [&](int r, int t) {
+        return min(part.start(r + 1), tile_start(r, t) + tile_rows);
+    };
+
+    band.reset(cam.cropped(part.start(rank), part.rows(rank)));
+    scratch.drawn = scratch.blended = 0;
+    for (int t; (t = queue.claim(rank)) < n_tiles(rank);)
+        rasterize(band, part.start(rank), splats, tile_start(rank, t),
+                  tile_end(rank, t), scratch.drawn, scratch.blended);
+
+    // Room for every tile of the other ranks, so that the number of tiles
+    // actually stolen can change between frames without allocating.
+    auto &stolen = scratch.stolen;
+    size_t max_stolen = 0;
+    for (int r = 0; r < part.size; r++)
+        if (r != rank) max_stolen += n_tiles(r);
+    if (stolen.size() < max_stolen) {
+        stolen.resize(max_stolen);
+        for (auto &tile : stolen) tile.image.reset(cam.cropped(0, tile_rows));
+    }
+    scratch.n_stolen = 0;
+    scratch.tile_rows = tile_rows;
+    for (int i = 1; i < part.size; i++) {
+        int victim = (rank + i) % part.size;
+        bool fetched = false;
+        for (int t; (t = queue.claim(victim)) < n_tiles(victim);) {
+            if (!fetched) window.fetch(victim, scratch.victim);
+            fetched = true;
+            int y0 = tile_start(victim, t), y1 = tile_end(victim, t);
+            auto &tile = stolen[scratch.n_stolen++];
+            tile.y0 = y0;
+            tile.image.reset(cam.cropped(y0, y1 - y0));
+            rasterize(tile.image, y0, scratch.victim, y0, y1, scratch.drawn,
+                      scratch.blended);
+        }
+    }
+}
+
+/**
+ * Sends the stolen tiles to the root and pastes them into the gathered
+ * image, completing the merge after gather_bands.
+ *
+ * @param image The full image on the root.
+ * @param scratch Holds the tiles this rank rendered for other ranks.
+ * @param cam The full-resolution camera.
+ * @param comm The communicator.
+ * @param root The rank holding the image.
+ */
+void merge_stolen(Image &image, StealScratch &scratch, const Camera &cam,
+                  MPI_Comm comm, int root = 0) {
+    TRACE_SCOPE("merge_stolen");
+    int rank, size, count = scratch.n_stolen;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    auto &counts = scratch.counts;
+    counts.resize(size);
+    MPI_Gather(&count, 1, MPI_INT, counts.data(), 1, MPI_INT, root, comm);
+
+    // Sized for a full tile, so that shorter tiles reuse the storage.
+    auto &rgba = scratch.rgba;
+    rgba.reserve(cam.image_size_x * scratch.tile_rows);
+    if (rank == root) scratch.tile.reset(cam.cropped(0, scratch.tile_rows));
+    std::span<StolenTile> stolen(scratch.stolen.data(), count);
+    if (rank != root) {
+        for (auto &tile : stolen) {
+            int header[2] = {tile.y0, tile.image.h};
+            tile.image.to_rgba(rgba);
+            MPI_Send(header, 2, MPI_INT, root, 0, comm);
+            MPI_Send(rgba.data(), rgba.size() * sizeof(v4_t), MPI_BYTE, root,
+                     0, comm);
+        }
+        return;
+    }
+    for (auto &tile : stolen) image.paste(tile.image, tile.y0);
+    for (int r = 0; r < size; r++) {
+        if (r == root) continue;
+        for (int i = 0; i < counts[r]; i++) {
+            int header[2];
+            MPI_Recv(header, 2, MPI_INT, r, 0, comm, MPI_STATUS_IGNORE);
+            auto &tile = scratch.tile;
+            tile.reset(cam.cropped(header[0], header[1]));
+            rgba.resize(tile.image.size());
+            MPI_Recv(rgba.data(), rgba.size() * sizeof(v4_t), MPI_BYTE, r, 0,
+                     comm, MPI_STATUS_IGNORE);
+            tile.from_rgba(rgba);
+            image.paste(tile, header[0]);
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,41 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "../src/splat_random.hpp"
+
+/*
+ * Checks that the random streams of the splats of generate_scene.cpp do
+ * not overlap: the first draws of neighbouring splats, and of the cluster
+ * centres counted down from the top index, are all distinct.
+ *
+ *   $ g++ -std=c++20 -O3 tests/splat_random_test.cpp -o splat_random_test
+ *   $ ./splat_random_test
+ */
+
+constexpr uint64_t n_splats = 20000;  ///< Splats per seed
+constexpr uint64_t n_clusters = 64;   ///< Cluster centres per seed
+constexpr int n_draws = 128;          ///< More than a splat uses
+
+int main() {
+    int failures = 0;
+    for (uint64_t seed : {0ull, 1ull, 7ull, 0x9e3779b97f4a7c15ull}) {
+        std::vector<uint64_t> draws;
+        auto add_stream = [&](uint64_t index) {
+            SplatRandom rng(seed, index);
+            for (int k = 0; k < n_draws; k++) draws.push_back(rng.next());
+        };
+        for (uint64_t i = 0; i < n_splats; i++) add_stream(i);
+        for (uint64_t c = 0; c < n_clusters; c++) add_stream(~c);
+
+        std::sort(draws.begin(), draws.end());
+        size_t repeated = 0;
+        for (size_t i = 1; i < draws.size(); i++)
+            repeated += draws[i] == draws[i - 1];
+        std::printf("seed %llu: %zu of %zu draws repeated\n",
+                    (unsigned long long)seed, repeated, draws.size());
+        failures += repeated > 0;
+    }
+    return failures > 0;
+}
@@ -0,0 +1,110 @@
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+
+#include "../src/vec.hpp"
+
+/*
+ * Checks that the SSE matrix products of vec_simd.hpp are bit-identical to
+ * the generic code of vec.hpp. The same file is built twice, with and
+ * without NO_SIMD; both builds compute mat_mul and mat_mul_T on the same
+ * random inputs, and the SIMD build compares its results with those the
+ * generic build wrote:
+ *
+ *   $ g++ -std=c++20 -O3 -DNO_SIMD tests/vec_simd_test.cpp -o generic
+ *   $ g++ -std=c++20 -O3 tests/vec_simd_test.cpp -o simd
+ *   $ ./generic > generic.txt && ./simd generic.txt
+ */
+
+using m4_t = mat<float, 4, 4>;
+using v4f_t = vec<float, 4>;
+
+constexpr int n_cases = 10000;
+
+/**
+ * @brief Random finite floats of both signs over a wide range of exponents,
+ * so that the products round differently depending on the summation order.
+ */
+struct RandomFloats {
+    std::mt19937 gen{12345};
+    std::uniform_real_distribution<float> mantissa{-1.0f, 1.0f};
+    std::uniform_int_distribution<int> exponent{-20, 20};
+
+    float operator()() { return std::ldexp(mantissa(gen), exponent(gen)); }
+
+    v4f_t vector() {
+        v4f_t v;
+        for (auto &x : v) x = (*this)();
+        return v;
+    }
+
+    m4_t matrix() {
+        m4_t m;
+        for (auto &row : m) row = vector();
+        return m;
+    }
+};
+
+/**
+ * @brief Appends the bit patterns of a vector to a line.
+ */
+void append_bits(std::string &line, const v4f_t &v) {
+    for (float x : v) {
+        uint32_t bits;
+        std::memcpy(&bits, &x, sizeof bits);
+        char hex[10];
+        std::snprintf(hex, sizeof hex, " %08x", bits);
+        line += hex;
+    }
+}
+
+/**
+ * @brief The results of one case: mat_mul with a vector, mat_mul_T and
+ * mat_mul with a matrix (which goes through mat_mul_T), as bit patterns.
+ */
+std::string run_case(RandomFloats &random) {
+    m4_t A = random.matrix(), B = random.matrix();
+    v4f_t v = random.vector();
+    std::string line;
+    append_bits(line, A.mat_mul(v));
+    for (auto &row : A.mat_mul_T(B)) append_bits(line, row);
+    for (auto &row : A.mat_mul(B)) append_bits(line, row);
+    return line;
+}
+
+int main(int argc, char **argv) {
+    RandomFloats random;
+    if (argc < 2) {
+        // Writing the reference.
+        for (int i = 0; i < n_cases; i++)
+            std::printf("%s\n", run_case(random).c_str());
+        return 0;
+    }
+
+    FILE *reference = std::fopen(argv[1], "r");
+    if (!reference) {
+        std::fprintf(stderr, "Cannot open %s\n", argv[1]);
+        return 1;
+    }
+#ifdef NO_SIMD
+    std::fprintf(stderr, "Warning: comparing two generic builds\n");
+#endif
+    int mismatches = 0;
+    char buf[512];
+    for (int i = 0; i < n_cases; i++) {
+        auto line = run_case(random) + "\n";
+        if (!std::fgets(buf, sizeof buf, reference)) {
+            std::fprintf(stderr, "%s ends after %d cases\n", argv[1], i);
+            return 1;
+        }
+        if (line != buf && mismatches++ < 5)
+            std::fprintf(stderr, "Case %d differs:\n  generic%s  simd   %s", i,
+                         buf, line.c_str());
+    }
+    std::fclose(reference);
+    std::printf("%d of %d cases differ\n", mismatches, n_cases);
+    return mismatches > 0;
+}